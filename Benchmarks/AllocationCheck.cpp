@@ -0,0 +1,265 @@
+//
+// Checks that steady state recording does not allocate. malloc, calloc, realloc and the aligned allocators behind av_malloc are
+// replaced by counting versions, the encoder warms up for a while and every allocation after that fails the run.
+//
+// Calls into libavcodec and libavformat are wrapped at link time and allocations inside them, or on the codec's own threads,
+// are counted apart: the FFmpeg 3.x encoders attach side data to every packet and the muxers grow their index, neither of
+// which the plugin controls. --strict fails on those too.
+//
+// Build: make AllocationCheck (see Makefile).
+//
+// Usage: AllocationCheck [--width 1280] [--height 720] [--fps 60] [--warmup 120] [--frames 600] [--codec h264|mpeg4|gif]
+//                        [--audio] [--strict] [--output allocation_check.mp4]
+//
+
+#include <stdio.h>
+#include <math.h>
+#include <atomic>
+#include <errno.h>
+#include <execinfo.h>
+#include <unistd.h>
+#include "BenchmarkTools.h"
+#include "Encoder.h"
+
+extern "C" {
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t count, size_t size);
+    void *__libc_realloc(void *pointer, size_t size);
+    void *__libc_memalign(size_t alignment, size_t size);
+    void __libc_free(void *pointer);
+}
+
+//Call stacks kept of the first allocations made by the plugin itself, printed when the check fails.
+#define RECORDED_STACKS 4
+#define STACK_DEPTH 12
+
+static std::atomic<bool> counting(false);
+static std::atomic<int64_t> ownAllocations(0);
+static std::atomic<int64_t> ownBytes(0);
+static std::atomic<int64_t> libraryAllocations(0);
+static std::atomic<int64_t> libraryBytes(0);
+
+static void *stacks[RECORDED_STACKS][STACK_DEPTH];
+static int stackDepths[RECORDED_STACKS];
+static std::atomic<int> recordedStacks(0);
+
+//Only the thread driving the encoder is checked, the rest belong to the codec. Depth counts nested library calls.
+static thread_local bool harnessThread = false;
+static thread_local int libraryDepth = 0;
+static thread_local bool inHook = false;
+
+static void count_allocation(size_t size)
+{
+    if (!counting.load(std::memory_order_relaxed) || inHook)
+    {
+        return;
+    }
+
+    if (!harnessThread || libraryDepth > 0)
+    {
+        libraryAllocations++;
+        libraryBytes += size;
+        return;
+    }
+
+    ownAllocations++;
+    ownBytes += size;
+
+    int slot = recordedStacks.fetch_add(1);
+
+    if (slot < RECORDED_STACKS)
+    {
+        //backtrace may allocate the first time it runs, main warms it up before counting starts.
+        inHook = true;
+        stackDepths[slot] = backtrace(stacks[slot], STACK_DEPTH);
+        inHook = false;
+    }
+}
+
+extern "C" {
+    void *malloc(size_t size)
+    {
+        count_allocation(size);
+        return __libc_malloc(size);
+    }
+
+    void *calloc(size_t count, size_t size)
+    {
+        count_allocation(count * size);
+        return __libc_calloc(count, size);
+    }
+
+    void *realloc(void *pointer, size_t size)
+    {
+        count_allocation(size);
+        return __libc_realloc(pointer, size);
+    }
+
+    void free(void *pointer)
+    {
+        __libc_free(pointer);
+    }
+
+    //av_malloc goes through posix_memalign on Linux.
+    int posix_memalign(void **pointer, size_t alignment, size_t size)
+    {
+        count_allocation(size);
+        void *memory = __libc_memalign(alignment, size);
+
+        if (memory == NULL)
+        {
+            return ENOMEM;
+        }
+
+        *pointer = memory;
+        return 0;
+    }
+
+    void *memalign(size_t alignment, size_t size)
+    {
+        count_allocation(size);
+        return __libc_memalign(alignment, size);
+    }
+
+    void *aligned_alloc(size_t alignment, size_t size)
+    {
+        count_allocation(size);
+        return __libc_memalign(alignment, size);
+    }
+
+    int __real_avcodec_encode_video2(AVCodecContext *context, AVPacket *packet, const AVFrame *frame, int *gotPacket);
+    int __real_avcodec_encode_audio2(AVCodecContext *context, AVPacket *packet, const AVFrame *frame, int *gotPacket);
+    int __real_av_write_frame(AVFormatContext *context, AVPacket *packet);
+    int __real_av_interleaved_write_frame(AVFormatContext *context, AVPacket *packet);
+
+    int __wrap_avcodec_encode_video2(AVCodecContext *context, AVPacket *packet, const AVFrame *frame, int *gotPacket)
+    {
+        libraryDepth++;
+        int ret = __real_avcodec_encode_video2(context, packet, frame, gotPacket);
+        libraryDepth--;
+        return ret;
+    }
+
+    int __wrap_avcodec_encode_audio2(AVCodecContext *context, AVPacket *packet, const AVFrame *frame, int *gotPacket)
+    {
+        libraryDepth++;
+        int ret = __real_avcodec_encode_audio2(context, packet, frame, gotPacket);
+        libraryDepth--;
+        return ret;
+    }
+
+    int __wrap_av_write_frame(AVFormatContext *context, AVPacket *packet)
+    {
+        libraryDepth++;
+        int ret = __real_av_write_frame(context, packet);
+        libraryDepth--;
+        return ret;
+    }
+
+    int __wrap_av_interleaved_write_frame(AVFormatContext *context, AVPacket *packet)
+    {
+        libraryDepth++;
+        int ret = __real_av_interleaved_write_frame(context, packet);
+        libraryDepth--;
+        return ret;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int width = bench_arg_int(argc, argv, "--width", 1280);
+    int height = bench_arg_int(argc, argv, "--height", 720);
+    int fps = bench_arg_int(argc, argv, "--fps", 60);
+    int warmup = bench_arg_int(argc, argv, "--warmup", 120);
+    int frames = bench_arg_int(argc, argv, "--frames", 600);
+    bool audio = bench_arg_flag(argc, argv, "--audio");
+    bool strict = bench_arg_flag(argc, argv, "--strict");
+    std::string codecName = bench_arg_string(argc, argv, "--codec", "h264");
+    std::string output = bench_arg_string(argc, argv, "--output", codecName == "gif" ? "allocation_check.gif" : "allocation_check.mp4");
+
+    CapturingCodec codec = codecName == "gif" ? GIF : (codecName == "mpeg4" ? MPEG4 : H264);
+    audio = audio && codec != GIF;
+    harnessThread = true;
+
+    void *warmStack[STACK_DEPTH];
+    backtrace(warmStack, STACK_DEPTH);
+
+    //Everything the loop touches is allocated before it starts.
+    const int sourceFrames = 8;
+    std::vector<uint8_t> source((size_t)width * height * 4 * sourceFrames);
+    for (int i = 0; i < sourceFrames; i++)
+    {
+        bench_fill_frame(source.data() + (size_t)i * width * height * 4, width, height, i);
+    }
+
+    const int sampleRate = 48000;
+    const int channels = 2;
+    int samplesPerFrame = sampleRate / fps;
+    std::vector<float> tone((size_t)samplesPerFrame * channels);
+
+    Encoder encoder(output, codec, 4000000, 2, false);
+
+    if (audio)
+    {
+        encoder.SetAudioFormat(sampleRate, channels);
+    }
+
+    if (encoder.StartEncoding(width, height, width, height, fps) < 0)
+    {
+        printf("Unable to start encoding %s\n", output.c_str());
+        return 1;
+    }
+
+    //One thread inserts and encodes in lock step, so every allocation in the window is attributed to a frame.
+    for (int i = 0; i < warmup + frames; i++)
+    {
+        if (i == warmup)
+        {
+            counting = true;
+        }
+
+        if (audio)
+        {
+            for (int s = 0; s < samplesPerFrame; s++)
+            {
+                float value = 0.2f * (float)sin(2.0 * M_PI * 440.0 * ((double)i * samplesPerFrame + s) / sampleRate);
+                tone[s * channels] = value;
+                tone[s * channels + 1] = value;
+            }
+
+            encoder.InsertAudio(tone.data(), samplesPerFrame);
+        }
+
+        encoder.InsertFrameUs(source.data() + (size_t)(i % sourceFrames) * width * height * 4, 4, 0, (int64_t)i * 1000000 / fps);
+        encoder.EncodeFrames(INT_MAX);
+    }
+
+    counting = false;
+    encoder.StopEncoding();
+    remove(output.c_str());
+
+    printf("%d steady state frames after %d warm up frames, %s %dx%d%s\n", frames, warmup, codecName.c_str(), width, height, audio ? " with audio" : "");
+    printf("plugin allocations   %8lld  (%lld bytes)\n", (long long)ownAllocations.load(), (long long)ownBytes.load());
+    printf("library allocations  %8lld  (%lld bytes, %.2f per frame)\n", (long long)libraryAllocations.load(), (long long)libraryBytes.load(),
+           frames > 0 ? (double)libraryAllocations.load() / frames : 0.0);
+
+    int stackCount = recordedStacks.load() < RECORDED_STACKS ? recordedStacks.load() : RECORDED_STACKS;
+
+    for (int i = 0; i < stackCount; i++)
+    {
+        printf("allocation %d:\n", i + 1);
+        fflush(stdout);
+
+        //The _fd variant writes straight to the descriptor instead of allocating the strings.
+        backtrace_symbols_fd(stacks[i] + 1, stackDepths[i] - 1, STDOUT_FILENO);
+    }
+
+    if (ownAllocations.load() > 0 || (strict && libraryAllocations.load() > 0))
+    {
+        printf("FAIL: steady state recording allocated\n");
+        return 1;
+    }
+
+    printf("PASS\n");
+    return 0;
+}
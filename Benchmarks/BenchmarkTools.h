@@ -0,0 +1,115 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+//Small helpers shared by the standalone benchmark executables.
+
+static inline int64_t bench_now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//Reads "--name value" from the command line, falls back to the default when missing.
+static inline int bench_arg_int(int argc, char **argv, const char *name, int defaultValue)
+{
+    for (int i = 1; i < argc - 1; i++)
+    {
+        if (strcmp(argv[i], name) == 0)
+        {
+            return atoi(argv[i + 1]);
+        }
+    }
+
+    return defaultValue;
+}
+
+static inline std::string bench_arg_string(int argc, char **argv, const char *name, const char *defaultValue)
+{
+    for (int i = 1; i < argc - 1; i++)
+    {
+        if (strcmp(argv[i], name) == 0)
+        {
+            return std::string(argv[i + 1]);
+        }
+    }
+
+    return std::string(defaultValue);
+}
+
+static inline bool bench_arg_flag(int argc, char **argv, const char *name)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], name) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//Fills an rgba frame with a diagonal gradient that moves with the frame index.
+static inline void bench_fill_frame(uint8_t *rgba, int width, int height, int frameIndex)
+{
+    for (int y = 0; y < height; y++)
+    {
+        uint8_t *row = rgba + (size_t)y * width * 4;
+
+        for (int x = 0; x < width; x++)
+        {
+            row[x * 4 + 0] = (uint8_t)(x + frameIndex * 3);
+            row[x * 4 + 1] = (uint8_t)(y + frameIndex * 2);
+            row[x * 4 + 2] = (uint8_t)(x + y + frameIndex);
+            row[x * 4 + 3] = 255;
+        }
+    }
+}
+
+//Median of the recorded samples, the samples are reordered.
+static inline int64_t bench_median(std::vector<int64_t> &samples)
+{
+    if (samples.empty())
+    {
+        return 0;
+    }
+
+    std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+    return samples[samples.size() / 2];
+}
+
+//Processor model for result files, so numbers from different machines are not mixed up.
+static inline std::string bench_cpu_model()
+{
+    std::string model = "unknown";
+    FILE *cpuinfo = fopen("/proc/cpuinfo", "r");
+
+    if (cpuinfo == NULL)
+    {
+        return model;
+    }
+
+    char line[256];
+
+    while (fgets(line, sizeof(line), cpuinfo) != NULL)
+    {
+        const char *colon = strchr(line, ':');
+
+        if (strncmp(line, "model name", 10) == 0 && colon != NULL)
+        {
+            model = std::string(colon + 2);
+            model.erase(model.find_last_not_of("\r\n") + 1);
+            break;
+        }
+    }
+
+    fclose(cpuinfo);
+    return model;
+}
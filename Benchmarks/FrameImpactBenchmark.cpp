@@ -0,0 +1,236 @@
+//
+// How much recording adds to a game's frame. A simulated render loop at a fixed frame budget runs once without recording
+// and once with the capture path (a readback-equivalent copy plus InsertFrame) every frame while a background thread encodes.
+// Reports the render thread time per frame for both runs, the difference, the capture call itself and the frames over budget.
+//
+// Build: make FrameImpactBenchmark (see Makefile).
+//
+// Usage: FrameImpactBenchmark [--width 1920] [--height 1080] [--fps 60] [--render-ms 10] [--seconds 10] [--codec h264|mpeg4]
+//                             [--output frame_impact.mp4] [--json frame_impact.json] [--max-missed <frames>]
+//
+// With --max-missed the exit code is 2 when recording pushed more than that many extra frames over budget, for regression runs.
+//
+
+#include <limits.h>
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "BenchmarkTools.h"
+#include "Encoder.h"
+
+struct PhaseResult
+{
+    std::vector<int64_t> frameNs;
+    std::vector<int64_t> captureNs;
+    int missed;
+    EncoderStats stats;
+};
+
+//Stand-in for the game's work on the render thread: passes over the back buffer, memory bound like real rendering.
+static void render_work(uint8_t *backBuffer, size_t size, int passes, int frameIndex)
+{
+    for (int pass = 0; pass < passes; pass++)
+    {
+        uint32_t *pixels = (uint32_t*)backBuffer;
+
+        for (size_t i = 0; i < size / 4; i++)
+        {
+            pixels[i] = (pixels[i] * 1664525u + (uint32_t)(frameIndex + pass)) | 0xff000000u;
+        }
+    }
+}
+
+static double percentile_ms(std::vector<int64_t> samples, double percentile)
+{
+    if (samples.empty())
+    {
+        return 0.0;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    size_t index = (size_t)(percentile / 100.0 * (samples.size() - 1));
+
+    return samples[index] / 1e6;
+}
+
+static PhaseResult run_phase(bool recording, int width, int height, int fps, int passes, int frames, CapturingCodec codec, const std::string &output)
+{
+    PhaseResult result;
+    result.missed = 0;
+    result.frameNs.reserve(frames);
+    result.captureNs.reserve(frames);
+    memset(&result.stats, 0, sizeof(result.stats));
+
+    size_t frameBytes = (size_t)width * height * 4;
+    std::vector<uint8_t> backBuffer(frameBytes);
+    std::vector<uint8_t> staging(frameBytes);
+    bench_fill_frame(backBuffer.data(), width, height, 0);
+
+    Encoder encoder(output, codec, 8000000, 2, false);
+    std::atomic<bool> running(true);
+    std::thread encodeThread;
+
+    if (recording)
+    {
+        if (encoder.StartEncoding(width, height, width, height, fps) < 0)
+        {
+            printf("Unable to start encoding %s\n", output.c_str());
+            return result;
+        }
+
+        //Like the plugin's host, encoding runs on its own thread and only competes for cores and memory bandwidth.
+        encodeThread = std::thread([&]() {
+            while (running)
+            {
+                encoder.EncodeFrames(INT_MAX);
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+    }
+
+    int64_t budgetNs = 1000000000LL / fps;
+    int64_t start = bench_now_ns();
+    int64_t nextFrame = start;
+
+    for (int i = 0; i < frames; i++)
+    {
+        int64_t frameStart = bench_now_ns();
+
+        render_work(backBuffer.data(), frameBytes, passes, i);
+
+        if (recording)
+        {
+            //The readback copies the finished frame out of the render target, the encoder copies it again into its queue.
+            int64_t captureStart = bench_now_ns();
+            memcpy(staging.data(), backBuffer.data(), frameBytes);
+            encoder.InsertFrameUs(staging.data(), 4, 0, (frameStart - start) / 1000);
+            result.captureNs.push_back(bench_now_ns() - captureStart);
+        }
+
+        int64_t frameEnd = bench_now_ns();
+        result.frameNs.push_back(frameEnd - frameStart);
+
+        if (frameEnd - frameStart > budgetNs)
+        {
+            result.missed++;
+        }
+
+        //Wait for the next vsync, a missed one pushes the schedule back instead of bursting to catch up.
+        nextFrame += budgetNs;
+
+        if (nextFrame < frameEnd)
+        {
+            nextFrame = frameEnd;
+        }
+        else
+        {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(nextFrame - frameEnd));
+        }
+    }
+
+    if (recording)
+    {
+        running = false;
+        encodeThread.join();
+        encoder.StopEncoding();
+        encoder.GetStats(&result.stats);
+    }
+
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    int width = bench_arg_int(argc, argv, "--width", 1920);
+    int height = bench_arg_int(argc, argv, "--height", 1080);
+    int fps = bench_arg_int(argc, argv, "--fps", 60);
+    int renderMs = bench_arg_int(argc, argv, "--render-ms", 10);
+    int seconds = bench_arg_int(argc, argv, "--seconds", 10);
+    std::string codecName = bench_arg_string(argc, argv, "--codec", "h264");
+    std::string output = bench_arg_string(argc, argv, "--output", "frame_impact.mp4");
+    std::string json = bench_arg_string(argc, argv, "--json", "");
+    int maxMissed = bench_arg_int(argc, argv, "--max-missed", -1);
+
+    CapturingCodec codec = codecName == "mpeg4" ? MPEG4 : H264;
+    int frames = fps * seconds;
+
+    //Calibrate the render work to the requested time on an idle machine.
+    std::vector<uint8_t> calibration((size_t)width * height * 4);
+    std::vector<int64_t> passTimes;
+
+    for (int i = 0; i < 9; i++)
+    {
+        int64_t start = bench_now_ns();
+        render_work(calibration.data(), calibration.size(), 1, i);
+        passTimes.push_back(bench_now_ns() - start);
+    }
+
+    int64_t passNs = bench_median(passTimes);
+    int passes = passNs > 0 ? (int)((int64_t)renderMs * 1000000 / passNs) : 1;
+    passes = passes > 0 ? passes : 1;
+
+    PhaseResult baseline = run_phase(false, width, height, fps, passes, frames, codec, output);
+    PhaseResult recording = run_phase(true, width, height, fps, passes, frames, codec, output);
+
+    static const double percentiles[] = { 50, 95, 99, 100 };
+
+    printf("budget %.2f ms, render work %d passes (%.2f ms), %d frames at %dx%d\n",
+           1000.0 / fps, passes, passes * passNs / 1e6, frames, width, height);
+    printf("%-22s %9s %9s %9s %9s %8s\n", "render thread ms", "p50", "p95", "p99", "max", "missed");
+
+    printf("%-22s", "baseline");
+    for (int i = 0; i < 4; i++) printf(" %9.3f", percentile_ms(baseline.frameNs, percentiles[i]));
+    printf(" %8d\n", baseline.missed);
+
+    printf("%-22s", "recording");
+    for (int i = 0; i < 4; i++) printf(" %9.3f", percentile_ms(recording.frameNs, percentiles[i]));
+    printf(" %8d\n", recording.missed);
+
+    printf("%-22s", "added");
+    for (int i = 0; i < 4; i++) printf(" %9.3f", percentile_ms(recording.frameNs, percentiles[i]) - percentile_ms(baseline.frameNs, percentiles[i]));
+    printf(" %8d\n", recording.missed - baseline.missed);
+
+    printf("%-22s", "capture call");
+    for (int i = 0; i < 4; i++) printf(" %9.3f", percentile_ms(recording.captureNs, percentiles[i]));
+    printf("\n");
+
+    int64_t dropped = recording.stats.droppedQueueFull + recording.stats.droppedDuplicate + recording.stats.droppedEndOfStream;
+    printf("encoded %lld, dropped %lld, queue high water %lld\n", (long long)recording.stats.framesEncoded, (long long)dropped,
+           (long long)recording.stats.queueHighWater);
+
+    if (!json.empty())
+    {
+        FILE *file = fopen(json.c_str(), "w");
+
+        if (file == NULL)
+        {
+            printf("Unable to write %s\n", json.c_str());
+            return 1;
+        }
+
+        const char *names[] = { "baseline", "recording", "capture" };
+        std::vector<int64_t> *series[] = { &baseline.frameNs, &recording.frameNs, &recording.captureNs };
+
+        fprintf(file, "{\n  \"cpu\": \"%s\",\n  \"width\": %d,\n  \"height\": %d,\n  \"fps\": %d,\n  \"renderMs\": %.3f,\n  \"frames\": %d,\n",
+                bench_cpu_model().c_str(), width, height, fps, passes * passNs / 1e6, frames);
+
+        for (int s = 0; s < 3; s++)
+        {
+            fprintf(file, "  \"%sMs\": {\"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f},\n", names[s],
+                    percentile_ms(*series[s], 50), percentile_ms(*series[s], 95), percentile_ms(*series[s], 99), percentile_ms(*series[s], 100));
+        }
+
+        fprintf(file, "  \"baselineMissed\": %d,\n  \"recordingMissed\": %d,\n  \"encoded\": %lld,\n  \"dropped\": %lld\n}\n",
+                baseline.missed, recording.missed, (long long)recording.stats.framesEncoded, (long long)dropped);
+        fclose(file);
+    }
+
+    if (maxMissed >= 0 && recording.missed - baseline.missed > maxMissed)
+    {
+        printf("recording missed %d more frames than allowed\n", recording.missed - baseline.missed - maxMissed);
+        return 2;
+    }
+
+    return 0;
+}
@@ -0,0 +1,157 @@
+//
+// Pixel buffer readback of the OpenGL core capturer, run headless on an EGL surfaceless context
+// (Mesa llvmpipe works, no display or GPU needed). Each frame clears an offscreen framebuffer,
+// draws a marker in the top-left corner and captures it into an H264 file.
+//
+// Build: make GLReadbackBenchmark (see Makefile).
+//
+// Usage: GLReadbackBenchmark [--width 1280] [--height 720] [--frames 120] [--depth 3] [--out gl_capture.mp4]
+//        Run with EGL_PLATFORM=surfaceless LIBGL_ALWAYS_SOFTWARE=1 to force llvmpipe.
+//
+
+#include <stdio.h>
+#include <thread>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include "BenchmarkTools.h"
+#include "Encoder.h"
+#include "RenderAPI.h"
+
+static bool create_context(EGLDisplay *display, EGLContext *context)
+{
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+    //Surfaceless needs no window system, fall back to the default display otherwise.
+    *display = getPlatformDisplay != NULL ? getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL) : EGL_NO_DISPLAY;
+
+    if (*display == EGL_NO_DISPLAY)
+    {
+        *display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    if (*display == EGL_NO_DISPLAY || !eglInitialize(*display, NULL, NULL))
+    {
+        fprintf(stderr, "Could not initialize EGL\n");
+        return false;
+    }
+
+    eglBindAPI(EGL_OPENGL_API);
+
+    const EGLint configAttributes[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+    EGLConfig config;
+    EGLint configCount = 0;
+
+    if (!eglChooseConfig(*display, configAttributes, &config, 1, &configCount) || configCount == 0)
+    {
+        fprintf(stderr, "No OpenGL capable EGL config\n");
+        return false;
+    }
+
+    const EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 2,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+
+    *context = eglCreateContext(*display, config, EGL_NO_CONTEXT, contextAttributes);
+
+    if (*context == EGL_NO_CONTEXT || !eglMakeCurrent(*display, EGL_NO_SURFACE, EGL_NO_SURFACE, *context))
+    {
+        fprintf(stderr, "Could not create a 3.2 core context\n");
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    int width = bench_arg_int(argc, argv, "--width", 1280);
+    int height = bench_arg_int(argc, argv, "--height", 720);
+    int frames = bench_arg_int(argc, argv, "--frames", 120);
+    int depth = bench_arg_int(argc, argv, "--depth", 3);
+    std::string out = bench_arg_string(argc, argv, "--out", "gl_capture.mp4");
+
+    EGLDisplay display;
+    EGLContext context;
+
+    if (!create_context(&display, &context))
+    {
+        return 1;
+    }
+
+    printf("Renderer: %s\n", (const char*)glGetString(GL_RENDERER));
+
+    //Surfaceless contexts have no default framebuffer, render into an offscreen one.
+    GLuint framebuffer, colorBuffer;
+    glGenRenderbuffers(1, &colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        fprintf(stderr, "Offscreen framebuffer incomplete\n");
+        return 1;
+    }
+
+    //No flip, the capturer already hands the encoder a top-down image.
+    Encoder encoder(out, H264, 4000000, 2, false);
+    encoder.StartEncoding(width, height, width, height, 30);
+
+    extern RenderAPI* Create_OpenGLCoreCapturer(UnityGfxRenderer apiType);
+    RenderAPI *api = Create_OpenGLCoreCapturer(kUnityGfxRendererOpenGLCore);
+    api->SetReadbackDepth(depth);
+    api->SetTargetFramerate(30);
+    api->SetExternalEncoder(&encoder);
+    api->StartCapturing(width, height);
+
+    int64_t total = 0;
+    int64_t worst = 0;
+
+    for (int i = 0; i < frames; i++)
+    {
+        glDisable(GL_SCISSOR_TEST);
+        glClearColor((i % 60) / 60.0f, 0.2f, 0.4f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        //GL counts rows from the bottom, this marker should end up in the top-left corner of the video.
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(0, height - height / 8, width / 8, height / 8);
+        glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        int64_t start = bench_now_ns();
+        api->ReadFrameBuffer();
+        int64_t elapsed = bench_now_ns() - start;
+
+        total += elapsed;
+        worst = elapsed > worst ? elapsed : worst;
+
+        std::this_thread::sleep_for(std::chrono::microseconds(33333));
+    }
+
+    //Release the pixel buffers while the context is still current.
+    api->StopCapturing();
+    api->ReadFrameBuffer();
+
+    encoder.StopEncoding();
+
+    printf("depth %d: mean %.1f us, max %.1f us, overruns %lld\n", depth, (double)total / frames / 1000.0, (double)worst / 1000.0, (long long)api->GetReadbackOverruns());
+
+    delete api;
+
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &colorBuffer);
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(display, context);
+    eglTerminate(display);
+
+    return 0;
+}
@@ -0,0 +1,294 @@
+//
+// Per kernel cost of the frame path: color conversion, scaling, the frame pool and the InsertFrame copy with and without the vertical flip.
+// Every kernel runs at 720p, 1080p, 1440p and 4K, results are printed and written as JSON for comparing commits and machines.
+//
+// Build: make KernelBenchmark (see Makefile).
+//
+// Usage: KernelBenchmark [--min-ms 300] [--json kernel_benchmark.json] [--label <commit>] [--kernel <name>]
+//
+
+#include <stdio.h>
+#include <vector>
+#include "BenchmarkTools.h"
+#include "Encoder.h"
+#include "FramePool.h"
+#include "RGB2YUV420.h"
+
+extern "C" {
+	#include "libswscale/swscale.h"
+	#include "libavutil/imgutils.h"
+}
+
+struct KernelResult
+{
+    std::string kernel;
+    int width;
+    int height;
+    double nsPerOp;
+    double nsPerPixel;
+    double gbPerSecond;
+};
+
+static std::vector<KernelResult> results;
+static std::string kernelFilter;
+
+//Warms caches and clocks for a fifth of minMs, then runs the kernel until minMs have passed and returns the median time of one call.
+template <typename Kernel>
+static int64_t measure(Kernel kernel, int minMs)
+{
+    std::vector<int64_t> samples;
+    int64_t warm = bench_now_ns() + (int64_t)minMs * 200000;
+
+    do
+    {
+        kernel();
+    } while (bench_now_ns() < warm);
+
+    int64_t end = bench_now_ns() + (int64_t)minMs * 1000000;
+
+    while (samples.size() < 5 || bench_now_ns() < end)
+    {
+        int64_t start = bench_now_ns();
+        kernel();
+        samples.push_back(bench_now_ns() - start);
+    }
+
+    return bench_median(samples);
+}
+
+static bool selected(const char *kernel)
+{
+    return kernelFilter.empty() || kernelFilter == kernel;
+}
+
+//Pixels and bytes are per call, bytes counts what the kernel reads plus what it writes.
+static void report(const char *kernel, int width, int height, double nsPerOp, double pixels, double bytes)
+{
+    KernelResult result;
+    result.kernel = kernel;
+    result.width = width;
+    result.height = height;
+    result.nsPerOp = nsPerOp;
+    result.nsPerPixel = pixels > 0 ? nsPerOp / pixels : 0.0;
+    result.gbPerSecond = bytes > 0 ? bytes / nsPerOp : 0.0;
+    results.push_back(result);
+
+    printf("%-24s %5dx%-5d %14.1f %12.3f %10.2f\n", kernel, width, height, nsPerOp, result.nsPerPixel, result.gbPerSecond);
+}
+
+static void bench_conversion(int width, int height, int minMs, const uint8_t *rgba)
+{
+    size_t pixels = (size_t)width * height;
+    std::vector<uint8_t> rgb(pixels * 3);
+    std::vector<uint8_t> yuv(pixels * 3 / 2);
+
+    for (size_t i = 0; i < pixels; i++)
+    {
+        memcpy(&rgb[i * 3], rgba + i * 4, 3);
+    }
+
+    if (selected("rgb2yuv420_rgba"))
+    {
+        int64_t ns = measure([&]() { rgb2yuv420(yuv.data(), (uint8_t*)rgba, 4, width, height); }, minMs);
+        report("rgb2yuv420_rgba", width, height, ns, pixels, pixels * 4 + yuv.size());
+    }
+
+    if (selected("rgb2yuv420_rgb"))
+    {
+        int64_t ns = measure([&]() { rgb2yuv420(yuv.data(), rgb.data(), 3, width, height); }, minMs);
+        report("rgb2yuv420_rgb", width, height, ns, pixels, rgb.size() + yuv.size());
+    }
+
+    if (selected("bgr2yuv420_bgra"))
+    {
+        int64_t ns = measure([&]() { bgr2yuv420(yuv.data(), (uint8_t*)rgba, 4, width, height); }, minMs);
+        report("bgr2yuv420_bgra", width, height, ns, pixels, pixels * 4 + yuv.size());
+    }
+
+    //What swscale would cost for the same conversion, as a reference for the hand written loop.
+    if (selected("sws_rgba_to_yuv420p"))
+    {
+        SwsContext *context = sws_getContext(width, height, AV_PIX_FMT_RGBA, width, height, AV_PIX_FMT_YUV420P, SWS_BILINEAR, NULL, NULL, NULL);
+        uint8_t *planes[4];
+        int linesizes[4];
+        av_image_alloc(planes, linesizes, width, height, AV_PIX_FMT_YUV420P, 32);
+
+        const uint8_t *source[1] = { rgba };
+        int sourceStride[1] = { width * 4 };
+
+        int64_t ns = measure([&]() { sws_scale(context, source, sourceStride, 0, height, planes, linesizes); }, minMs);
+        report("sws_rgba_to_yuv420p", width, height, ns, pixels, pixels * 4 + yuv.size());
+
+        av_freep(&planes[0]);
+        sws_freeContext(context);
+    }
+}
+
+//The encoder's downscale from the capture size to the codec size, same format and filter as EncoderSession.
+static void bench_scale(int width, int height, int minMs, const uint8_t *rgba)
+{
+    static const int ratios[][2] = { { 3, 4 }, { 2, 3 }, { 1, 2 } };
+    static const char *names[] = { "sws_scale_3/4", "sws_scale_2/3", "sws_scale_1/2" };
+
+    if (!selected(names[0]) && !selected(names[1]) && !selected(names[2]))
+    {
+        return;
+    }
+
+    uint8_t *source[4];
+    int sourceLinesizes[4];
+    av_image_alloc(source, sourceLinesizes, width, height, AV_PIX_FMT_YUV420P, 32);
+    rgb2yuv420(source[0], (uint8_t*)rgba, 4, width, height);
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (!selected(names[i]))
+        {
+            continue;
+        }
+
+        int outputWidth = (width * ratios[i][0] / ratios[i][1]) & ~1;
+        int outputHeight = (height * ratios[i][0] / ratios[i][1]) & ~1;
+
+        SwsContext *context = sws_getContext(width, height, AV_PIX_FMT_YUV420P, outputWidth, outputHeight, AV_PIX_FMT_YUV420P, SWS_BILINEAR, NULL, NULL, NULL);
+        uint8_t *output[4];
+        int outputLinesizes[4];
+        av_image_alloc(output, outputLinesizes, outputWidth, outputHeight, AV_PIX_FMT_YUV420P, 32);
+
+        int64_t ns = measure([&]() { sws_scale(context, (const uint8_t * const *)source, sourceLinesizes, 0, height, output, outputLinesizes); }, minMs);
+
+        double pixels = (double)width * height;
+        report(names[i], width, height, ns, pixels, pixels * 3 / 2 + (double)outputWidth * outputHeight * 3 / 2);
+
+        av_freep(&output[0]);
+        sws_freeContext(context);
+    }
+
+    av_freep(&source[0]);
+}
+
+static void bench_frame_pool(int width, int height, int minMs)
+{
+    if (!selected("framepool_pop_push"))
+    {
+        return;
+    }
+
+    const int operations = 1000;
+    FramePool pool(10, width * height * 4);
+
+    //Batches of pairs, a single pop and push is below the clock resolution.
+    int64_t ns = measure([&]() {
+        for (int i = 0; i < operations; i++)
+        {
+            FrameObject_t *frame = pool.popFrame();
+            pool.pushFrame(frame);
+        }
+    }, minMs);
+
+    report("framepool_pop_push", width, height, (double)ns / operations, 0, 0);
+}
+
+//The render thread side of a capture, the copy into a pooled frame under the queue lock.
+static void bench_insert(const char *kernel, bool flip, int width, int height, int minMs, const uint8_t *rgba)
+{
+    if (!selected(kernel))
+    {
+        return;
+    }
+
+    const char *file = "kernel_benchmark_insert.mp4";
+    const int batch = 8;
+
+    //A small output keeps the untimed encode that returns frames to the pool short.
+    Encoder encoder(std::string(file), MPEG4, 1000000, 2, flip);
+    encoder.StartEncoding(width, height, 320, 180, 60);
+
+    int64_t timestamp = 0;
+    std::vector<int64_t> samples;
+    int64_t end = bench_now_ns() + (int64_t)minMs * 1000000;
+
+    //The pool holds 10 frames, so insert a batch, time each call, and let the encoder drain it before the next one.
+    while (samples.size() < 5 || bench_now_ns() < end)
+    {
+        for (int i = 0; i < batch; i++)
+        {
+            timestamp += 16667;
+
+            int64_t start = bench_now_ns();
+            encoder.InsertFrameUs((uint8_t*)rgba, 4, 0, timestamp);
+            samples.push_back(bench_now_ns() - start);
+        }
+
+        encoder.EncodeFrames(INT_MAX);
+    }
+
+    encoder.StopEncoding();
+    remove(file);
+
+    //The first batch paid for page faults on fresh pool frames.
+    samples.erase(samples.begin(), samples.begin() + batch);
+
+    double pixels = (double)width * height;
+    report(kernel, width, height, bench_median(samples), pixels, pixels * 8);
+}
+
+static int write_json(const char *path, const std::string &label)
+{
+    FILE *file = fopen(path, "w");
+
+    if (file == NULL)
+    {
+        return -1;
+    }
+
+    fprintf(file, "{\n  \"label\": \"%s\",\n  \"cpu\": \"%s\",\n  \"results\": [\n", label.c_str(), bench_cpu_model().c_str());
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const KernelResult &result = results[i];
+        fprintf(file, "    {\"kernel\": \"%s\", \"width\": %d, \"height\": %d, \"nsPerOp\": %.1f, \"nsPerPixel\": %.4f, \"gbPerSecond\": %.3f}%s\n",
+                result.kernel.c_str(), result.width, result.height, result.nsPerOp, result.nsPerPixel, result.gbPerSecond,
+                i + 1 < results.size() ? "," : "");
+    }
+
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int minMs = bench_arg_int(argc, argv, "--min-ms", 300);
+    std::string jsonPath = bench_arg_string(argc, argv, "--json", "kernel_benchmark.json");
+    std::string label = bench_arg_string(argc, argv, "--label", "");
+    kernelFilter = bench_arg_string(argc, argv, "--kernel", "");
+
+    static const int resolutions[][2] = { { 1280, 720 }, { 1920, 1080 }, { 2560, 1440 }, { 3840, 2160 } };
+
+    printf("%-24s %-11s %14s %12s %10s\n", "kernel", "resolution", "ns/op", "ns/pixel", "GB/s");
+
+    for (int r = 0; r < 4; r++)
+    {
+        int width = resolutions[r][0];
+        int height = resolutions[r][1];
+
+        std::vector<uint8_t> rgba((size_t)width * height * 4);
+        bench_fill_frame(rgba.data(), width, height, r);
+
+        bench_conversion(width, height, minMs, rgba.data());
+        bench_scale(width, height, minMs, rgba.data());
+        bench_frame_pool(width, height, minMs);
+        bench_insert("insert_frame", false, width, height, minMs, rgba.data());
+        bench_insert("insert_frame_flip", true, width, height, minMs, rgba.data());
+    }
+
+    if (write_json(jsonPath.c_str(), label) < 0)
+    {
+        printf("Unable to write %s\n", jsonPath.c_str());
+        return 1;
+    }
+
+    return 0;
+}
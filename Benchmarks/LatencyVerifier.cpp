@@ -0,0 +1,349 @@
+//
+// Ground truth latency of a recording made with frame markers. Decodes the output, reads the frame index stamped into every picture
+// and joins it with the encoder's marker log: the insert time of that index and the write time of the packet with that pts.
+// Reports capture to written latency per frame and every index that was dropped, duplicated or came out of order.
+//
+// Record with PipelineBenchmark --marker-log, the synthetic backend or any capture that stamps frame_marker_stamp, and SetMarkerLog.
+//
+// Build: make LatencyVerifier (see Makefile).
+//
+// Usage: LatencyVerifier --video pipeline_benchmark.mp4 --log markers.txt [--capture-width <pixels>] [--csv frames.csv]
+//                        [--json latency.json]
+//
+
+#include <stdio.h>
+#include <map>
+#include <set>
+#include <vector>
+#include <inttypes.h>
+#include "BenchmarkTools.h"
+#include "FrameMarker.h"
+
+extern "C" {
+	#include "libavformat/avformat.h"
+	#include "libavcodec/avcodec.h"
+	#include "libswscale/swscale.h"
+	#include "libavutil/imgutils.h"
+}
+
+struct DecodedFrame
+{
+    int64_t pts;
+    int64_t marker;
+};
+
+struct MarkerLog
+{
+    //First insert time of every marker, and how many inserts had no readable marker.
+    std::map<int64_t, int64_t> insertUs;
+    int unreadable;
+
+    std::map<int64_t, int64_t> writeUs;
+};
+
+static int read_log(const char *path, MarkerLog *log)
+{
+    FILE *file = fopen(path, "r");
+
+    if (file == NULL)
+    {
+        return -1;
+    }
+
+    log->unreadable = 0;
+
+    char kind[16];
+    int64_t key;
+    int64_t timeUs;
+
+    while (fscanf(file, "%15s %" SCNd64 " %" SCNd64, kind, &key, &timeUs) == 3)
+    {
+        if (strcmp(kind, "insert") == 0)
+        {
+            if (key < 0)
+            {
+                log->unreadable++;
+            }
+            else if (log->insertUs.find(key) == log->insertUs.end())
+            {
+                log->insertUs[key] = timeUs;
+            }
+        }
+        else if (strcmp(kind, "write") == 0)
+        {
+            log->writeUs[key] = timeUs;
+        }
+    }
+
+    fclose(file);
+
+    return 0;
+}
+
+//Decoded frames in presentation order, marker -1 where the pattern could not be read.
+static int decode_markers(const char *path, int captureWidth, std::vector<DecodedFrame> *frames)
+{
+    AVFormatContext *format = NULL;
+
+    if (avformat_open_input(&format, path, NULL, NULL) < 0 || avformat_find_stream_info(format, NULL) < 0)
+    {
+        return -1;
+    }
+
+    AVCodec *decoder = NULL;
+    int streamIndex = av_find_best_stream(format, AVMEDIA_TYPE_VIDEO, -1, -1, &decoder, 0);
+
+    if (streamIndex < 0 || avcodec_open2(format->streams[streamIndex]->codec, decoder, NULL) < 0)
+    {
+        avformat_close_input(&format);
+        return -1;
+    }
+
+    AVCodecContext *context = format->streams[streamIndex]->codec;
+    AVFrame *decoded = av_frame_alloc();
+    SwsContext *converter = NULL;
+    std::vector<uint8_t> luma;
+
+    AVPacket packet;
+    av_init_packet(&packet);
+    packet.data = NULL;
+    packet.size = 0;
+
+    bool draining = false;
+
+    while (true)
+    {
+        if (!draining && av_read_frame(format, &packet) < 0)
+        {
+            //Empty packets flush the frames the decoder still holds.
+            draining = true;
+            packet.data = NULL;
+            packet.size = 0;
+        }
+
+        if (!draining && packet.stream_index != streamIndex)
+        {
+            av_packet_unref(&packet);
+            continue;
+        }
+
+        int gotFrame = 0;
+        avcodec_decode_video2(context, decoded, &gotFrame, &packet);
+
+        if (!draining)
+        {
+            av_packet_unref(&packet);
+        }
+
+        if (gotFrame)
+        {
+            //Gray conversion handles yuv and the palette frames of gif the same way.
+            int width = decoded->width;
+            int height = decoded->height;
+            luma.resize((size_t)width * height);
+
+            uint8_t *planes[1] = { luma.data() };
+            int linesizes[1] = { width };
+            converter = sws_getCachedContext(converter, width, height, (AVPixelFormat)decoded->format,
+                                             width, height, AV_PIX_FMT_GRAY8, SWS_POINT, NULL, NULL, NULL);
+            sws_scale(converter, (const uint8_t * const *)decoded->data, decoded->linesize, 0, height, planes, linesizes);
+
+            double scale = captureWidth > 0 ? (double)width / captureWidth : 1.0;
+            uint32_t index = 0;
+
+            DecodedFrame frame;
+            frame.pts = av_frame_get_best_effort_timestamp(decoded);
+            frame.marker = frame_marker_read_luma(luma.data(), width, width, height, scale, &index) == 0 ? index : -1;
+            frames->push_back(frame);
+        }
+        else if (draining)
+        {
+            break;
+        }
+    }
+
+    sws_freeContext(converter);
+    av_frame_free(&decoded);
+    avcodec_close(context);
+    avformat_close_input(&format);
+
+    return 0;
+}
+
+static double percentile_ms(std::vector<int64_t> samples, double percentile)
+{
+    if (samples.empty())
+    {
+        return 0.0;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    size_t index = (size_t)(percentile / 100.0 * (samples.size() - 1));
+
+    return samples[index] / 1000.0;
+}
+
+static void print_indices(const char *label, const std::vector<int64_t> &indices)
+{
+    printf("%s %zu", label, indices.size());
+
+    for (size_t i = 0; i < indices.size() && i < 20; i++)
+    {
+        printf("%s%" PRId64, i == 0 ? ": " : ", ", indices[i]);
+    }
+
+    printf("%s\n", indices.size() > 20 ? ", ..." : "");
+}
+
+int main(int argc, char **argv)
+{
+    std::string video = bench_arg_string(argc, argv, "--video", "");
+    std::string logPath = bench_arg_string(argc, argv, "--log", "");
+    int captureWidth = bench_arg_int(argc, argv, "--capture-width", 0);
+    std::string csv = bench_arg_string(argc, argv, "--csv", "");
+    std::string json = bench_arg_string(argc, argv, "--json", "");
+
+    if (video.empty() || logPath.empty())
+    {
+        printf("Usage: LatencyVerifier --video <file> --log <marker log> [--capture-width <pixels>] [--csv <file>] [--json <file>]\n");
+        return 1;
+    }
+
+    MarkerLog log;
+
+    if (read_log(logPath.c_str(), &log) < 0)
+    {
+        printf("Unable to read %s\n", logPath.c_str());
+        return 1;
+    }
+
+    av_register_all();
+
+    std::vector<DecodedFrame> frames;
+
+    if (decode_markers(video.c_str(), captureWidth, &frames) < 0)
+    {
+        printf("Unable to decode %s\n", video.c_str());
+        return 1;
+    }
+
+    FILE *csvFile = csv.empty() ? NULL : fopen(csv.c_str(), "w");
+
+    if (csvFile != NULL)
+    {
+        fprintf(csvFile, "marker,pts,insertUs,writtenUs,latencyUs\n");
+    }
+
+    std::set<int64_t> seen;
+    std::vector<int64_t> latencies;
+    std::vector<int64_t> duplicated;
+    std::vector<int64_t> outOfOrder;
+    int unreadable = 0;
+    int unmatched = 0;
+    int64_t lastMarker = -1;
+
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        const DecodedFrame &frame = frames[i];
+
+        if (frame.marker < 0)
+        {
+            unreadable++;
+            continue;
+        }
+
+        //CFR fills skipped slots with the previous capture, only its first appearance is its latency.
+        if (!seen.insert(frame.marker).second)
+        {
+            duplicated.push_back(frame.marker);
+            continue;
+        }
+
+        if (frame.marker < lastMarker)
+        {
+            outOfOrder.push_back(frame.marker);
+        }
+        lastMarker = frame.marker;
+
+        std::map<int64_t, int64_t>::iterator insert = log.insertUs.find(frame.marker);
+        std::map<int64_t, int64_t>::iterator write = log.writeUs.find(frame.pts);
+
+        if (insert == log.insertUs.end() || write == log.writeUs.end())
+        {
+            unmatched++;
+            continue;
+        }
+
+        int64_t latency = write->second - insert->second;
+        latencies.push_back(latency);
+
+        if (csvFile != NULL)
+        {
+            fprintf(csvFile, "%" PRId64 ",%" PRId64 ",%" PRId64 ",%" PRId64 ",%" PRId64 "\n",
+                    frame.marker, frame.pts, insert->second, write->second, latency);
+        }
+    }
+
+    if (csvFile != NULL)
+    {
+        fclose(csvFile);
+    }
+
+    //Every index the encoder was handed that never made it into the file, and gaps that never reached InsertFrame.
+    std::vector<int64_t> dropped;
+    std::vector<int64_t> neverInserted;
+
+    if (!log.insertUs.empty())
+    {
+        int64_t first = log.insertUs.begin()->first;
+        int64_t last = log.insertUs.rbegin()->first;
+
+        for (int64_t marker = first; marker <= last; marker++)
+        {
+            if (seen.count(marker) != 0)
+            {
+                continue;
+            }
+
+            if (log.insertUs.count(marker) != 0)
+            {
+                dropped.push_back(marker);
+            }
+            else
+            {
+                neverInserted.push_back(marker);
+            }
+        }
+    }
+
+    printf("decoded %zu frames, %zu distinct markers, %zu inserted, %d inserts and %d frames without a readable marker\n",
+           frames.size(), seen.size(), log.insertUs.size(), log.unreadable, unreadable);
+    printf("latency ms  p50 %.2f  p95 %.2f  p99 %.2f  max %.2f  (%zu frames, %d without a log entry)\n",
+           percentile_ms(latencies, 50), percentile_ms(latencies, 95), percentile_ms(latencies, 99), percentile_ms(latencies, 100),
+           latencies.size(), unmatched);
+    print_indices("dropped", dropped);
+    print_indices("duplicated", duplicated);
+    print_indices("out of order", outOfOrder);
+    print_indices("never inserted", neverInserted);
+
+    if (!json.empty())
+    {
+        FILE *file = fopen(json.c_str(), "w");
+
+        if (file == NULL)
+        {
+            printf("Unable to write %s\n", json.c_str());
+            return 1;
+        }
+
+        fprintf(file, "{\n  \"decoded\": %zu,\n  \"distinct\": %zu,\n  \"inserted\": %zu,\n  \"unreadable\": %d,\n  \"unmatched\": %d,\n",
+                frames.size(), seen.size(), log.insertUs.size(), unreadable, unmatched);
+        fprintf(file, "  \"latencyMs\": {\"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f},\n",
+                percentile_ms(latencies, 50), percentile_ms(latencies, 95), percentile_ms(latencies, 99), percentile_ms(latencies, 100));
+        fprintf(file, "  \"dropped\": %zu,\n  \"duplicated\": %zu,\n  \"outOfOrder\": %zu,\n  \"neverInserted\": %zu\n}\n",
+                dropped.size(), duplicated.size(), outOfOrder.size(), neverInserted.size());
+        fclose(file);
+    }
+
+    return 0;
+}
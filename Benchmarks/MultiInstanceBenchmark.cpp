@@ -0,0 +1,192 @@
+//
+// Aggregate throughput of independent Encoder instances running in parallel.
+// Every round decodes the first instance's file again, the run fails when it does not decode cleanly.
+//
+// Build: make MultiInstanceBenchmark (see Makefile).
+//
+// Usage: MultiInstanceBenchmark [--width 1280] [--height 720] [--frames 300] [--max-instances 8] [--gop-chunk 0]
+//
+
+#include <stdio.h>
+#include <thread>
+#include <vector>
+#include "BenchmarkTools.h"
+#include "Encoder.h"
+
+extern "C" {
+	#include "libavformat/avformat.h"
+	#include "libavcodec/avcodec.h"
+}
+
+static void run_instance(int index, int width, int height, int frames, int gopChunk, const uint8_t *source)
+{
+    char file[64];
+    snprintf(file, 64, "multi_instance_%d.mp4", index);
+
+    Encoder encoder(std::string(file), H264, 4000000, 2, false);
+
+    //With a chunk length each instance also spreads its own gops across every core.
+    if (gopChunk > 0)
+    {
+        encoder.SetParallelGopMode(gopChunk, 0, 512);
+    }
+
+    encoder.StartEncoding(width, height, width, height, 30);
+
+    for (int i = 0; i < frames; i++)
+    {
+        //Frames are already in memory, this measures conversion and encoding only.
+        encoder.InsertFrame((uint8_t*)source + (size_t)(i % 8) * width * height * 4, 4, (int64_t)i * 1000 / 30);
+        encoder.EncodeFrames(1);
+    }
+
+    encoder.StopEncoding();
+}
+
+//Counts decoded frames and decoder errors, bitstream errors are reported instead of concealed.
+static int decode_file(const char *file, int *frames, int *errors)
+{
+    AVFormatContext *format = NULL;
+
+    if (avformat_open_input(&format, file, NULL, NULL) < 0 || avformat_find_stream_info(format, NULL) < 0)
+    {
+        return -1;
+    }
+
+    AVCodec *decoder = NULL;
+    int streamIndex = av_find_best_stream(format, AVMEDIA_TYPE_VIDEO, -1, -1, &decoder, 0);
+
+    if (streamIndex < 0)
+    {
+        avformat_close_input(&format);
+        return -1;
+    }
+
+    AVCodecContext *context = format->streams[streamIndex]->codec;
+    context->err_recognition |= AV_EF_EXPLODE;
+
+    if (avcodec_open2(context, decoder, NULL) < 0)
+    {
+        avformat_close_input(&format);
+        return -1;
+    }
+
+    AVFrame *decoded = av_frame_alloc();
+    *frames = 0;
+    *errors = 0;
+
+    AVPacket packet;
+    av_init_packet(&packet);
+    packet.data = NULL;
+    packet.size = 0;
+
+    bool draining = false;
+
+    while (true)
+    {
+        if (!draining && av_read_frame(format, &packet) < 0)
+        {
+            //Empty packets flush the frames the decoder still holds.
+            draining = true;
+            packet.data = NULL;
+            packet.size = 0;
+        }
+
+        if (!draining && packet.stream_index != streamIndex)
+        {
+            av_packet_unref(&packet);
+            continue;
+        }
+
+        int gotFrame = 0;
+        if (avcodec_decode_video2(context, decoded, &gotFrame, &packet) < 0 || (gotFrame && decoded->decode_error_flags != 0))
+        {
+            (*errors)++;
+        }
+
+        if (!draining)
+        {
+            av_packet_unref(&packet);
+        }
+
+        if (gotFrame)
+        {
+            (*frames)++;
+        }
+        else if (draining)
+        {
+            break;
+        }
+    }
+
+    av_frame_free(&decoded);
+    avcodec_close(context);
+    avformat_close_input(&format);
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int width = bench_arg_int(argc, argv, "--width", 1280);
+    int height = bench_arg_int(argc, argv, "--height", 720);
+    int frames = bench_arg_int(argc, argv, "--frames", 300);
+    int maxInstances = bench_arg_int(argc, argv, "--max-instances", (int)std::thread::hardware_concurrency());
+    int gopChunk = bench_arg_int(argc, argv, "--gop-chunk", 0);
+
+    //A handful of distinct frames shared read-only by every instance.
+    std::vector<uint8_t> source((size_t)width * height * 4 * 8);
+    for (int i = 0; i < 8; i++)
+    {
+        bench_fill_frame(source.data() + (size_t)i * width * height * 4, width, height, i);
+    }
+
+    printf("%-10s %-12s %-14s %-10s\n", "instances", "seconds", "aggregate fps", "scaling");
+
+    double singleFps = 0.0;
+    bool decodeFailed = false;
+
+    for (int instances = 1; instances <= maxInstances; instances *= 2)
+    {
+        int64_t start = bench_now_ns();
+
+        std::vector<std::thread> workers;
+        for (int i = 0; i < instances; i++)
+        {
+            workers.push_back(std::thread(run_instance, i, width, height, frames, gopChunk, source.data()));
+        }
+
+        for (size_t i = 0; i < workers.size(); i++)
+        {
+            workers[i].join();
+        }
+
+        double seconds = (double)(bench_now_ns() - start) / 1e9;
+        double fps = (double)instances * frames / seconds;
+
+        if (instances == 1)
+        {
+            singleFps = fps;
+        }
+
+        printf("%-10d %-12.3f %-14.1f %-10.2f\n", instances, seconds, fps, fps / singleFps);
+
+        //Parallel gops mux packets of the worker codecs under the stream header, a mismatch shows up here.
+        int decodedFrames = 0;
+        int decodeErrors = 0;
+
+        if (decode_file("multi_instance_0.mp4", &decodedFrames, &decodeErrors) < 0 || decodedFrames != frames || decodeErrors > 0)
+        {
+            printf("multi_instance_0.mp4: decoded %d of %d frames, %d errors\n", decodedFrames, frames, decodeErrors);
+            decodeFailed = true;
+        }
+    }
+
+    if (decodeFailed)
+    {
+        printf("FAIL: output did not decode cleanly\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,311 @@
+//
+// End to end capture to file: a producer thread inserts synthetic frames, an encode thread drains them, StopEncoding finishes the file.
+// Paced mode inserts on a real time 1/fps schedule like a game would, --asap inserts as fast as the encoder keeps up.
+//
+// Build: make PipelineBenchmark (see Makefile).
+//
+// Usage: PipelineBenchmark [--width 1920] [--height 1080] [--fps 60] [--seconds 10] [--codec h264|mpeg4|gif] [--bitrate 8000000]
+//                          [--asap] [--output pipeline_benchmark.mp4] [--trace trace.json] [--json pipeline_benchmark.json]
+//                          [--marker-log markers.txt]
+//
+// --marker-log stamps the frame index into every frame and has the encoder log insert and write times, check it with LatencyVerifier.
+//
+
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include "BenchmarkTools.h"
+#include "Encoder.h"
+#include "FrameMarker.h"
+
+//Distinct frames cycled by the producer, generated up front so drawing them is not measured.
+#define SOURCE_FRAMES 8
+
+//Frames the asap producer lets queue up before it waits for the encoder, below the encoder's own limit so nothing is dropped.
+#define ASAP_QUEUE_DEPTH 8
+
+struct ThreadCpu
+{
+    std::string name;
+    double userMs;
+    double systemMs;
+};
+
+//User and system time of every live thread of the process, codec worker threads included.
+static std::vector<ThreadCpu> thread_cpu_times()
+{
+    std::vector<ThreadCpu> threads;
+    DIR *tasks = opendir("/proc/self/task");
+
+    if (tasks == NULL)
+    {
+        return threads;
+    }
+
+    double msPerTick = 1000.0 / sysconf(_SC_CLK_TCK);
+    struct dirent *entry;
+
+    while ((entry = readdir(tasks)) != NULL)
+    {
+        if (entry->d_name[0] == '.')
+        {
+            continue;
+        }
+
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/self/task/%s/stat", entry->d_name);
+
+        FILE *file = fopen(path, "r");
+        if (file == NULL)
+        {
+            continue;
+        }
+
+        char line[512];
+        bool read = fgets(line, sizeof(line), file) != NULL;
+        fclose(file);
+
+        //The name is in parentheses and may contain spaces, the counters follow the closing one.
+        char *open = read ? strchr(line, '(') : NULL;
+        char *close = read ? strrchr(line, ')') : NULL;
+
+        if (open == NULL || close == NULL)
+        {
+            continue;
+        }
+
+        unsigned long long utime = 0;
+        unsigned long long stime = 0;
+
+        if (sscanf(close + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) != 2)
+        {
+            continue;
+        }
+
+        ThreadCpu thread;
+        thread.name = std::string(entry->d_name) + " " + std::string(open + 1, close - open - 1);
+        thread.userMs = utime * msPerTick;
+        thread.systemMs = stime * msPerTick;
+        threads.push_back(thread);
+    }
+
+    closedir(tasks);
+    return threads;
+}
+
+//For the benchmark's own threads, which have exited by the time the others are sampled.
+static ThreadCpu current_thread_cpu(const char *name)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+
+    ThreadCpu thread;
+    thread.name = name;
+    thread.userMs = usage.ru_utime.tv_sec * 1000.0 + usage.ru_utime.tv_usec / 1000.0;
+    thread.systemMs = usage.ru_stime.tv_sec * 1000.0 + usage.ru_stime.tv_usec / 1000.0;
+
+    return thread;
+}
+
+static int64_t pending_frames(Encoder *encoder)
+{
+    EncoderStats stats;
+    encoder->GetStats(&stats);
+
+    return stats.framesInserted - stats.framesEncoded - stats.droppedQueueFull - stats.droppedDuplicate - stats.droppedEndOfStream;
+}
+
+int main(int argc, char **argv)
+{
+    int width = bench_arg_int(argc, argv, "--width", 1920);
+    int height = bench_arg_int(argc, argv, "--height", 1080);
+    int fps = bench_arg_int(argc, argv, "--fps", 60);
+    int seconds = bench_arg_int(argc, argv, "--seconds", 10);
+    int bitrate = bench_arg_int(argc, argv, "--bitrate", 8000000);
+    bool asap = bench_arg_flag(argc, argv, "--asap");
+    std::string codecName = bench_arg_string(argc, argv, "--codec", "h264");
+    std::string output = bench_arg_string(argc, argv, "--output", codecName == "gif" ? "pipeline_benchmark.gif" : "pipeline_benchmark.mp4");
+    std::string trace = bench_arg_string(argc, argv, "--trace", "");
+    std::string json = bench_arg_string(argc, argv, "--json", "");
+    std::string markerLog = bench_arg_string(argc, argv, "--marker-log", "");
+
+    CapturingCodec codec = codecName == "gif" ? GIF : (codecName == "mpeg4" ? MPEG4 : H264);
+    int frames = fps * seconds;
+
+    std::vector<uint8_t> source((size_t)width * height * 4 * SOURCE_FRAMES);
+    for (int i = 0; i < SOURCE_FRAMES; i++)
+    {
+        bench_fill_frame(source.data() + (size_t)i * width * height * 4, width, height, i);
+    }
+
+    Encoder encoder(output, codec, bitrate, 2, false);
+
+    if (!trace.empty())
+    {
+        encoder.SetTraceFile(trace);
+    }
+
+    if (!markerLog.empty())
+    {
+        encoder.SetMarkerLog(markerLog);
+    }
+
+    if (encoder.StartEncoding(width, height, width, height, fps) < 0)
+    {
+        printf("Unable to start encoding %s\n", output.c_str());
+        return 1;
+    }
+
+    std::atomic<bool> producing(true);
+    std::vector<int64_t> insertTimes;
+    insertTimes.reserve(frames);
+    int lateFrames = 0;
+    ThreadCpu encodeCpu;
+    ThreadCpu producerCpu;
+    int64_t start = bench_now_ns();
+
+    std::thread encodeThread([&]() {
+        while (producing)
+        {
+            encoder.EncodeFrames(INT_MAX);
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+        }
+
+        encodeCpu = current_thread_cpu("encode");
+    });
+
+    std::thread producerThread([&]() {
+        int64_t frameNs = 1000000000LL / fps;
+
+        for (int i = 0; i < frames; i++)
+        {
+            uint8_t *frame = source.data() + (size_t)(i % SOURCE_FRAMES) * width * height * 4;
+            int64_t timestampUs;
+
+            if (asap)
+            {
+                while (pending_frames(&encoder) >= ASAP_QUEUE_DEPTH)
+                {
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                }
+
+                timestampUs = (int64_t)i * 1000000 / fps;
+            }
+            else
+            {
+                //A slot that has already passed is inserted late rather than skipped, the timestamp says when it really happened.
+                int64_t due = start + i * frameNs;
+                int64_t now = bench_now_ns();
+
+                if (now < due)
+                {
+                    std::this_thread::sleep_for(std::chrono::nanoseconds(due - now));
+                }
+                else if (now - due > frameNs)
+                {
+                    lateFrames++;
+                }
+
+                timestampUs = (bench_now_ns() - start) / 1000;
+            }
+
+            if (!markerLog.empty())
+            {
+                frame_marker_stamp(frame, width * 4, width, height, (uint32_t)i);
+            }
+
+            int64_t insertStart = bench_now_ns();
+            encoder.InsertFrameUs(frame, 4, 0, timestampUs);
+            insertTimes.push_back(bench_now_ns() - insertStart);
+        }
+
+        producerCpu = current_thread_cpu("producer");
+    });
+
+    producerThread.join();
+    producing = false;
+    encodeThread.join();
+
+    //Sampled before the stop so the codec's worker threads are still there to read.
+    std::vector<ThreadCpu> threads = thread_cpu_times();
+    threads.insert(threads.begin(), encodeCpu);
+    threads.insert(threads.begin(), producerCpu);
+    EncoderStats stats;
+    encoder.GetStats(&stats);
+
+    int64_t stopStart = bench_now_ns();
+    encoder.StopEncoding();
+    int64_t end = bench_now_ns();
+
+    encoder.GetStats(&stats);
+
+    double wallSeconds = (end - start) / 1e9;
+    double sustainedFps = stats.framesEncoded / wallSeconds;
+    int64_t dropped = stats.droppedQueueFull + stats.droppedDuplicate + stats.droppedEndOfStream;
+
+    struct stat fileInfo;
+    long long outputBytes = stat(output.c_str(), &fileInfo) == 0 ? (long long)fileInfo.st_size : -1;
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    double peakRssMB = usage.ru_maxrss / 1024.0;
+
+    std::sort(insertTimes.begin(), insertTimes.end());
+    double insertP50 = insertTimes.empty() ? 0 : insertTimes[insertTimes.size() / 2] / 1e6;
+    double insertP99 = insertTimes.empty() ? 0 : insertTimes[insertTimes.size() * 99 / 100] / 1e6;
+
+    printf("mode              %s\n", asap ? "asap" : "paced");
+    printf("input             %dx%d %s @ %d fps, %d frames\n", width, height, codecName.c_str(), fps, frames);
+    printf("wall time         %.3f s (stop %.3f s)\n", wallSeconds, (end - stopStart) / 1e9);
+    printf("sustained fps     %.1f\n", sustainedFps);
+    printf("encoded           %lld\n", (long long)stats.framesEncoded);
+    printf("dropped           %lld (queue full %lld, duplicate %lld, end of stream %lld)\n", (long long)dropped,
+           (long long)stats.droppedQueueFull, (long long)stats.droppedDuplicate, (long long)stats.droppedEndOfStream);
+    printf("late slots        %d\n", lateFrames);
+    printf("latency ms        p50 %.2f  p95 %.2f  p99 %.2f\n", stats.latency.p50Ns / 1e6, stats.latency.p95Ns / 1e6, stats.latency.p99Ns / 1e6);
+    printf("insert ms         p50 %.3f  p99 %.3f\n", insertP50, insertP99);
+    printf("queue high water  %lld\n", (long long)stats.queueHighWater);
+    printf("peak rss          %.1f MB\n", peakRssMB);
+    printf("output            %s, %lld bytes\n", output.c_str(), outputBytes);
+    printf("cpu per thread (user + system ms)\n");
+
+    for (size_t i = 0; i < threads.size(); i++)
+    {
+        printf("  %-28s %10.0f %10.0f\n", threads[i].name.c_str(), threads[i].userMs, threads[i].systemMs);
+    }
+
+    if (!json.empty())
+    {
+        FILE *file = fopen(json.c_str(), "w");
+
+        if (file == NULL)
+        {
+            printf("Unable to write %s\n", json.c_str());
+            return 1;
+        }
+
+        fprintf(file, "{\n  \"cpu\": \"%s\",\n  \"mode\": \"%s\",\n  \"codec\": \"%s\",\n  \"width\": %d,\n  \"height\": %d,\n  \"fps\": %d,\n  \"frames\": %d,\n",
+                bench_cpu_model().c_str(), asap ? "asap" : "paced", codecName.c_str(), width, height, fps, frames);
+        fprintf(file, "  \"wallSeconds\": %.3f,\n  \"sustainedFps\": %.2f,\n  \"encoded\": %lld,\n  \"dropped\": %lld,\n  \"lateSlots\": %d,\n",
+                wallSeconds, sustainedFps, (long long)stats.framesEncoded, (long long)dropped, lateFrames);
+        fprintf(file, "  \"latencyMs\": {\"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f},\n  \"insertMs\": {\"p50\": %.4f, \"p99\": %.4f},\n",
+                stats.latency.p50Ns / 1e6, stats.latency.p95Ns / 1e6, stats.latency.p99Ns / 1e6, insertP50, insertP99);
+        fprintf(file, "  \"peakRssMB\": %.1f,\n  \"outputBytes\": %lld,\n  \"threads\": [\n", peakRssMB, outputBytes);
+
+        for (size_t i = 0; i < threads.size(); i++)
+        {
+            fprintf(file, "    {\"name\": \"%s\", \"userMs\": %.0f, \"systemMs\": %.0f}%s\n", threads[i].name.c_str(),
+                    threads[i].userMs, threads[i].systemMs, i + 1 < threads.size() ? "," : "");
+        }
+
+        fprintf(file, "  ]\n}\n");
+        fclose(file);
+    }
+
+    return 0;
+}
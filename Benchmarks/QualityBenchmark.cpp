@@ -0,0 +1,420 @@
+//
+// Encode speed against quality and size over a grid of codec, preset, crf or bitrate and resolution.
+// Every cell encodes the same synthetic reference clip, decodes the file again and compares it with the source by luma PSNR and SSIM.
+//
+// Build: make QualityBenchmark (see Makefile).
+//
+// Usage: QualityBenchmark [--frames 120] [--fps 60] [--bitrate 8000000] [--heights 720,1080] [--codecs h264,mpeg4,gif]
+//                         [--json quality_benchmark.json] [--keep]
+//
+
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include <sys/stat.h>
+#include "BenchmarkTools.h"
+#include "Encoder.h"
+#include "RGB2YUV420.h"
+
+extern "C" {
+	#include "libavformat/avformat.h"
+	#include "libavcodec/avcodec.h"
+	#include "libswscale/swscale.h"
+	#include "libavutil/imgutils.h"
+}
+
+struct QualityCell
+{
+    std::string codec;
+    std::string preset;
+    int crf;
+    int width;
+    int height;
+    double encodeFps;
+    long long bytes;
+    double kbps;
+    double psnr;
+    double ssim;
+};
+
+//A mix that is neither trivial nor pure noise: a drifting gradient, a scrolling fine texture,
+//a moving solid block and sharp one pixel lines like UI text. Deterministic for a frame index at any size.
+static void fill_scene(uint8_t *rgba, int width, int height, int frameIndex)
+{
+    int blockX = (frameIndex * width / 160) % (width - width / 6);
+    int blockY = height / 3;
+
+    for (int y = 0; y < height; y++)
+    {
+        uint8_t *row = rgba + (size_t)y * width * 4;
+
+        for (int x = 0; x < width; x++)
+        {
+            uint8_t *pixel = row + x * 4;
+
+            if (y < height / 2)
+            {
+                pixel[0] = (uint8_t)(x * 255 / width + frameIndex);
+                pixel[1] = (uint8_t)(y * 255 / height);
+                pixel[2] = (uint8_t)(128 + frameIndex * 2);
+            }
+            else
+            {
+                uint32_t hash = (uint32_t)((x + frameIndex * 2) / 4) * 2654435761u ^ (uint32_t)(y / 4) * 40503u;
+                uint8_t texture = (uint8_t)(hash >> 24);
+                pixel[0] = texture;
+                pixel[1] = (uint8_t)(texture / 2 + 64);
+                pixel[2] = (uint8_t)(255 - texture);
+            }
+
+            if (x >= blockX && x < blockX + width / 6 && y >= blockY && y < blockY + height / 6)
+            {
+                pixel[0] = 230;
+                pixel[1] = 40;
+                pixel[2] = 40;
+            }
+
+            if (y % 24 == 0 || (x % 48 < 2 && y > height * 3 / 4))
+            {
+                pixel[0] = 255;
+                pixel[1] = 255;
+                pixel[2] = 255;
+            }
+
+            pixel[3] = 255;
+        }
+    }
+}
+
+static std::vector<std::string> split_list(const std::string &list)
+{
+    std::vector<std::string> items;
+    size_t start = 0;
+
+    while (start <= list.size())
+    {
+        size_t end = list.find(',', start);
+        end = end == std::string::npos ? list.size() : end;
+
+        if (end > start)
+        {
+            items.push_back(list.substr(start, end - start));
+        }
+
+        start = end + 1;
+    }
+
+    return items;
+}
+
+//Mean SSIM over 8x8 windows spaced 4 pixels apart.
+static double ssim_plane(const uint8_t *a, int strideA, const uint8_t *b, int strideB, int width, int height)
+{
+    const double c1 = (0.01 * 255) * (0.01 * 255);
+    const double c2 = (0.03 * 255) * (0.03 * 255);
+    double total = 0.0;
+    int windows = 0;
+
+    for (int y = 0; y + 8 <= height; y += 4)
+    {
+        for (int x = 0; x + 8 <= width; x += 4)
+        {
+            int64_t sumA = 0, sumB = 0, sumAA = 0, sumBB = 0, sumAB = 0;
+
+            for (int j = 0; j < 8; j++)
+            {
+                const uint8_t *rowA = a + (size_t)(y + j) * strideA + x;
+                const uint8_t *rowB = b + (size_t)(y + j) * strideB + x;
+
+                for (int i = 0; i < 8; i++)
+                {
+                    sumA += rowA[i];
+                    sumB += rowB[i];
+                    sumAA += rowA[i] * rowA[i];
+                    sumBB += rowB[i] * rowB[i];
+                    sumAB += rowA[i] * rowB[i];
+                }
+            }
+
+            double meanA = sumA / 64.0;
+            double meanB = sumB / 64.0;
+            double varianceA = sumAA / 64.0 - meanA * meanA;
+            double varianceB = sumBB / 64.0 - meanB * meanB;
+            double covariance = sumAB / 64.0 - meanA * meanB;
+
+            total += ((2 * meanA * meanB + c1) * (2 * covariance + c2)) / ((meanA * meanA + meanB * meanB + c1) * (varianceA + varianceB + c2));
+            windows++;
+        }
+    }
+
+    return windows > 0 ? total / windows : 0.0;
+}
+
+//Decodes the file and compares every frame with the regenerated source frame of the same index.
+//Returns the number of frames compared, PSNR is taken over the summed error of all of them.
+static int compare_file(const char *file, int width, int height, double *psnr, double *ssim)
+{
+    AVFormatContext *format = NULL;
+
+    if (avformat_open_input(&format, file, NULL, NULL) < 0 || avformat_find_stream_info(format, NULL) < 0)
+    {
+        return -1;
+    }
+
+    AVCodec *decoder = NULL;
+    int streamIndex = av_find_best_stream(format, AVMEDIA_TYPE_VIDEO, -1, -1, &decoder, 0);
+
+    if (streamIndex < 0 || avcodec_open2(format->streams[streamIndex]->codec, decoder, NULL) < 0)
+    {
+        avformat_close_input(&format);
+        return -1;
+    }
+
+    AVCodecContext *context = format->streams[streamIndex]->codec;
+    AVFrame *decoded = av_frame_alloc();
+    SwsContext *converter = NULL;
+
+    uint8_t *planes[4];
+    int linesizes[4];
+    av_image_alloc(planes, linesizes, width, height, AV_PIX_FMT_YUV420P, 32);
+
+    std::vector<uint8_t> source((size_t)width * height * 4);
+    std::vector<uint8_t> reference((size_t)width * height * 3 / 2);
+
+    int frames = 0;
+    double squaredError = 0.0;
+    double ssimTotal = 0.0;
+
+    AVPacket packet;
+    av_init_packet(&packet);
+    packet.data = NULL;
+    packet.size = 0;
+
+    bool draining = false;
+
+    while (true)
+    {
+        if (!draining && av_read_frame(format, &packet) < 0)
+        {
+            //Empty packets flush the frames the decoder still holds.
+            draining = true;
+            packet.data = NULL;
+            packet.size = 0;
+        }
+
+        if (!draining && packet.stream_index != streamIndex)
+        {
+            av_packet_unref(&packet);
+            continue;
+        }
+
+        //Undecodable packets are skipped, their frames show up as missing in the count.
+        int gotFrame = 0;
+        avcodec_decode_video2(context, decoded, &gotFrame, &packet);
+
+        if (!draining)
+        {
+            av_packet_unref(&packet);
+        }
+
+        if (gotFrame)
+        {
+            converter = sws_getCachedContext(converter, decoded->width, decoded->height, (AVPixelFormat)decoded->format,
+                                             width, height, AV_PIX_FMT_YUV420P, SWS_BILINEAR, NULL, NULL, NULL);
+            sws_scale(converter, (const uint8_t * const *)decoded->data, decoded->linesize, 0, decoded->height, planes, linesizes);
+
+            //The same conversion the encoder runs, so only the codec's loss is measured.
+            fill_scene(source.data(), width, height, frames);
+            rgb2yuv420(reference.data(), source.data(), 4, width, height);
+
+            for (int y = 0; y < height; y++)
+            {
+                const uint8_t *rowA = reference.data() + (size_t)y * width;
+                const uint8_t *rowB = planes[0] + (size_t)y * linesizes[0];
+
+                for (int x = 0; x < width; x++)
+                {
+                    int difference = rowA[x] - rowB[x];
+                    squaredError += difference * difference;
+                }
+            }
+
+            ssimTotal += ssim_plane(reference.data(), width, planes[0], linesizes[0], width, height);
+            frames++;
+        }
+        else if (draining)
+        {
+            break;
+        }
+    }
+
+    double meanSquaredError = frames > 0 ? squaredError / ((double)frames * width * height) : 0.0;
+    *psnr = meanSquaredError > 0 ? 10.0 * log10(255.0 * 255.0 / meanSquaredError) : 100.0;
+    *ssim = frames > 0 ? ssimTotal / frames : 0.0;
+
+    av_freep(&planes[0]);
+    sws_freeContext(converter);
+    av_frame_free(&decoded);
+    avcodec_close(context);
+    avformat_close_input(&format);
+
+    return frames;
+}
+
+static bool run_cell(QualityCell *cell, int frames, int fps, int bitrate, bool keep)
+{
+    char file[128];
+    snprintf(file, sizeof(file), "quality_%s_%s_%d_%dp.%s", cell->codec.c_str(), cell->preset.c_str(), cell->crf, cell->height,
+             cell->codec == "gif" ? "gif" : "mp4");
+
+    CapturingCodec codec = cell->codec == "gif" ? GIF : (cell->codec == "mpeg4" ? MPEG4 : H264);
+    Encoder encoder(std::string(file), codec, bitrate, 2, false);
+    encoder.SetQuality(cell->preset == "-" ? std::string() : cell->preset, cell->crf);
+
+    std::vector<uint8_t> frame((size_t)cell->width * cell->height * 4);
+    int64_t encodeNs = 0;
+    int64_t start = bench_now_ns();
+
+    if (encoder.StartEncoding(cell->width, cell->height, cell->width, cell->height, fps) < 0)
+    {
+        return false;
+    }
+
+    encodeNs += bench_now_ns() - start;
+
+    for (int i = 0; i < frames; i++)
+    {
+        //Drawing the clip is not part of the encode time.
+        fill_scene(frame.data(), cell->width, cell->height, i);
+
+        start = bench_now_ns();
+        encoder.InsertFrameUs(frame.data(), 4, 0, (int64_t)i * 1000000 / fps);
+        encoder.EncodeFrames(INT_MAX);
+        encodeNs += bench_now_ns() - start;
+    }
+
+    start = bench_now_ns();
+    encoder.StopEncoding();
+    encodeNs += bench_now_ns() - start;
+
+    struct stat fileInfo;
+    cell->bytes = stat(file, &fileInfo) == 0 ? (long long)fileInfo.st_size : 0;
+    cell->encodeFps = frames / (encodeNs / 1e9);
+    cell->kbps = cell->bytes * 8.0 / 1000.0 / ((double)frames / fps);
+
+    int compared = compare_file(file, cell->width, cell->height, &cell->psnr, &cell->ssim);
+
+    if (!keep)
+    {
+        remove(file);
+    }
+
+    if (compared != frames)
+    {
+        printf("%s: decoded %d of %d frames\n", file, compared, frames);
+    }
+
+    return compared > 0;
+}
+
+int main(int argc, char **argv)
+{
+    int frames = bench_arg_int(argc, argv, "--frames", 120);
+    int fps = bench_arg_int(argc, argv, "--fps", 60);
+    int bitrate = bench_arg_int(argc, argv, "--bitrate", 8000000);
+    std::vector<std::string> heights = split_list(bench_arg_string(argc, argv, "--heights", "720,1080"));
+    std::vector<std::string> codecs = split_list(bench_arg_string(argc, argv, "--codecs", "h264,mpeg4,gif"));
+    std::string json = bench_arg_string(argc, argv, "--json", "quality_benchmark.json");
+    bool keep = bench_arg_flag(argc, argv, "--keep");
+
+    av_register_all();
+
+    //0 encodes to --bitrate, otherwise the x264 crf or the mpeg4 qscale.
+    static const char *h264Presets[] = { "ultrafast", "veryfast", "medium" };
+    static const int h264Crf[] = { 0, 18, 23, 28 };
+    static const int mpeg4Quality[] = { 0, 3, 6, 10 };
+
+    std::vector<QualityCell> grid;
+
+    for (size_t h = 0; h < heights.size(); h++)
+    {
+        QualityCell cell;
+        cell.height = atoi(heights[h].c_str()) & ~1;
+        cell.width = (cell.height * 16 / 9) & ~1;
+
+        for (size_t c = 0; c < codecs.size(); c++)
+        {
+            cell.codec = codecs[c];
+
+            if (cell.codec == "h264")
+            {
+                for (int p = 0; p < 3; p++)
+                {
+                    for (int q = 0; q < 4; q++)
+                    {
+                        cell.preset = h264Presets[p];
+                        cell.crf = h264Crf[q];
+                        grid.push_back(cell);
+                    }
+                }
+            }
+            else if (cell.codec == "mpeg4")
+            {
+                for (int q = 0; q < 4; q++)
+                {
+                    cell.preset = "-";
+                    cell.crf = mpeg4Quality[q];
+                    grid.push_back(cell);
+                }
+            }
+            else if (cell.codec == "gif")
+            {
+                cell.preset = "-";
+                cell.crf = 0;
+                grid.push_back(cell);
+            }
+        }
+    }
+
+    printf("%-6s %-10s %-5s %-10s %10s %10s %10s %8s %8s\n", "codec", "preset", "crf", "size", "enc fps", "kbytes", "kbps", "psnr-y", "ssim-y");
+
+    std::vector<QualityCell> results;
+
+    for (size_t i = 0; i < grid.size(); i++)
+    {
+        QualityCell cell = grid[i];
+
+        if (!run_cell(&cell, frames, fps, bitrate, keep))
+        {
+            printf("%-6s %-10s %-5d %5dx%-4d failed\n", cell.codec.c_str(), cell.preset.c_str(), cell.crf, cell.width, cell.height);
+            continue;
+        }
+
+        printf("%-6s %-10s %-5d %5dx%-4d %10.1f %10lld %10.0f %8.2f %8.4f\n", cell.codec.c_str(), cell.preset.c_str(), cell.crf,
+               cell.width, cell.height, cell.encodeFps, cell.bytes / 1024, cell.kbps, cell.psnr, cell.ssim);
+        results.push_back(cell);
+    }
+
+    FILE *file = fopen(json.c_str(), "w");
+
+    if (file == NULL)
+    {
+        printf("Unable to write %s\n", json.c_str());
+        return 1;
+    }
+
+    fprintf(file, "{\n  \"cpu\": \"%s\",\n  \"frames\": %d,\n  \"fps\": %d,\n  \"bitrate\": %d,\n  \"cells\": [\n", bench_cpu_model().c_str(), frames, fps, bitrate);
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const QualityCell &cell = results[i];
+        fprintf(file, "    {\"codec\": \"%s\", \"preset\": \"%s\", \"crf\": %d, \"width\": %d, \"height\": %d, \"encodeFps\": %.2f, \"bytes\": %lld, \"kbps\": %.1f, \"psnrY\": %.3f, \"ssimY\": %.5f}%s\n",
+                cell.codec.c_str(), cell.preset.c_str(), cell.crf, cell.width, cell.height, cell.encodeFps, cell.bytes, cell.kbps, cell.psnr, cell.ssim,
+                i + 1 < results.size() ? "," : "");
+    }
+
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+
+    return 0;
+}
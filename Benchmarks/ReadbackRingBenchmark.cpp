@@ -0,0 +1,58 @@
+//
+// Render thread cost of the readback ring against the synthetic backend with a fixed GPU latency.
+//
+// Build: make ReadbackRingBenchmark (see Makefile).
+//
+// Usage: ReadbackRingBenchmark [--width 1920] [--height 1080] [--frames 120] [--latency-us 30000] [--max-depth 4]
+//
+
+#include <stdio.h>
+#include <thread>
+#include "BenchmarkTools.h"
+#include "RenderAPI.h"
+
+extern RenderAPI* CreateRenderAPI_Synthetic(int gpuLatencyUs);
+
+int main(int argc, char **argv)
+{
+    int width = bench_arg_int(argc, argv, "--width", 1920);
+    int height = bench_arg_int(argc, argv, "--height", 1080);
+    int frames = bench_arg_int(argc, argv, "--frames", 120);
+    int latencyUs = bench_arg_int(argc, argv, "--latency-us", 30000);
+    int maxDepth = bench_arg_int(argc, argv, "--max-depth", 4);
+
+    printf("%-8s %-14s %-14s %-10s\n", "depth", "mean us", "max us", "overruns");
+
+    for (int depth = 1; depth <= maxDepth; depth++)
+    {
+        RenderAPI *api = CreateRenderAPI_Synthetic(latencyUs);
+        api->SetReadbackDepth(depth);
+        api->SetTargetFramerate(60);
+
+        //No encoder attached, this measures the ring plus drawing the synthetic content.
+        api->StartCapturing(width, height);
+
+        int64_t total = 0;
+        int64_t worst = 0;
+
+        for (int i = 0; i < frames; i++)
+        {
+            int64_t start = bench_now_ns();
+            api->ReadFrameBuffer();
+            int64_t elapsed = bench_now_ns() - start;
+
+            total += elapsed;
+            worst = elapsed > worst ? elapsed : worst;
+
+            //A 60 fps render loop.
+            std::this_thread::sleep_for(std::chrono::microseconds(16667));
+        }
+
+        printf("%-8d %-14.1f %-14.1f %-10lld\n", depth, (double)total / frames / 1000.0, (double)worst / 1000.0, (long long)api->GetReadbackOverruns());
+
+        api->StopCapturing();
+        delete api;
+    }
+
+    return 0;
+}
@@ -0,0 +1,74 @@
+//
+// Desktop capture through the X11 MIT-SHM backend. Records an X screen for a few seconds and reports
+// how many due frames were read back and how many were skipped by XDamage because nothing changed.
+//
+// Build: make X11CaptureBenchmark (see Makefile).
+//
+// Usage: X11CaptureBenchmark [--display :99] [--window 0] [--width 1280] [--height 720] [--fps 30] [--seconds 5] [--out desktop.mp4]
+//        Against Xvfb: Xvfb :99 -screen 0 1280x720x24 & X11CaptureBenchmark --display :99
+//
+
+#include <stdio.h>
+#include <thread>
+#include "BenchmarkTools.h"
+#include "Encoder.h"
+#include "RenderAPI.h"
+
+extern RenderAPI* CreateRenderAPI_X11(const char *displayName, unsigned long window);
+
+static void print_log(const char *message)
+{
+    fprintf(stderr, "%s\n", message);
+}
+
+int main(int argc, char **argv)
+{
+    std::string display = bench_arg_string(argc, argv, "--display", "");
+    unsigned long window = strtoul(bench_arg_string(argc, argv, "--window", "0").c_str(), NULL, 0);
+    int width = bench_arg_int(argc, argv, "--width", 1280);
+    int height = bench_arg_int(argc, argv, "--height", 720);
+    int fps = bench_arg_int(argc, argv, "--fps", 30);
+    int seconds = bench_arg_int(argc, argv, "--seconds", 5);
+    std::string out = bench_arg_string(argc, argv, "--out", "desktop.mp4");
+
+    //X rows are top-down, no flip.
+    Encoder encoder(out, H264, 4000000, 2, false);
+    encoder.StartEncoding(width, height, width, height, fps);
+
+    RenderAPI *api = CreateRenderAPI_X11(display.c_str(), window);
+    api->SetDebugCallback(print_log);
+    api->SetTargetFramerate(fps);
+    api->SetExternalEncoder(&encoder);
+    api->StartCapturing(width, height);
+
+    int64_t end = bench_now_ns() + (int64_t)seconds * 1000000000;
+    int64_t total = 0;
+    int64_t worst = 0;
+    int calls = 0;
+
+    //Poll faster than the capture rate, the pacer decides which calls read a frame.
+    while (bench_now_ns() < end)
+    {
+        int64_t start = bench_now_ns();
+        api->ReadFrameBuffer();
+        int64_t elapsed = bench_now_ns() - start;
+
+        total += elapsed;
+        worst = elapsed > worst ? elapsed : worst;
+        calls++;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(4));
+    }
+
+    api->StopCapturing();
+    api->ReadFrameBuffer();
+
+    encoder.StopEncoding();
+
+    printf("calls %d, mean %.1f us, max %.1f us, unchanged %lld, paced out %lld\n", calls, (double)total / calls / 1000.0,
+           (double)worst / 1000.0, (long long)api->GetUnchangedFrames(), (long long)api->GetSkippedFrames());
+
+    delete api;
+
+    return 0;
+}
@@ -6,6 +6,9 @@
 #include "TimeTools.h"
 #include "Encoder.h"
 #include "Muxer.h"
+#include "HandleTable.h"
+#include "Logger.h"
+#include "Tracer.h"
 #include <assert.h>
 
 static void UNITY_INTERFACE_API OnGraphicsDeviceEvent(UnityGfxDeviceEventType eventType);
@@ -13,9 +16,11 @@ static void UNITY_INTERFACE_API OnRenderEvent(int eventID);
 
 static LogCallback debugLog = NULL;
 static std::string debugPath;
-static Encoder *encoder = nullptr;
-static Muxer *muxer = nullptr;
+static HandleTable<Encoder> encoders;
+static HandleTable<Muxer> muxers;
+static std::shared_ptr<Encoder> capturingEncoder;
 static RenderAPI* currentAPI = nullptr;
+static bool frameMarkers = false;
 static UnityGfxRenderer deviceType = kUnityGfxRendererNull;
 static IUnityInterfaces* unityInterfaces = nullptr;
 static IUnityGraphics* unityGraphics = nullptr;
@@ -42,27 +47,122 @@ extern "C" {
 	int __stdcall CreateEncoder(const char* videoPath, int codec, int width, int height, int framerate, int bitrate, int iframeInterval) {
 		
 		CapturingCodec inputCodec = static_cast<CapturingCodec>(codec);
-		encoder = new Encoder(std::string(videoPath), inputCodec, bitrate, iframeInterval, true);
+		Encoder *encoder = new Encoder(std::string(videoPath), inputCodec, bitrate, iframeInterval, true);
 		encoder->SetDebugPath(debugPath);
 		encoder->SetDebugLog(debugLog);
 
-		return 0;
+		return encoders.Add(encoder);
+	}
+
+	int __stdcall DestroyEncoder(int encoderHandle) {
+		if (encoders.Remove(encoderHandle))
+		{
+			return 0;
+		}
+
+		return -1;
+	}
+
+	//Keeps the frame pool and conversion buffers warm, the next StartEncoding with the same geometry only reopens the codec and this file.
+	int __stdcall SetOutputFile(int encoderHandle, const char* videoPath)
+	{
+		std::shared_ptr<Encoder> encoder = encoders.Get(encoderHandle);
+
+		if (encoder != nullptr)
+		{
+			encoder->SetOutputFile(std::string(videoPath));
+			return 0;
+		}
+
+		return -1;
+	}
+
+	int __stdcall SetTraceFile(int encoderHandle, const char* tracePath)
+	{
+		std::shared_ptr<Encoder> encoder = encoders.Get(encoderHandle);
+
+		if (encoder != nullptr)
+		{
+			encoder->SetTraceFile(tracePath != NULL ? std::string(tracePath) : std::string());
+			return 0;
+		}
+
+		return -1;
 	}
 
-	int __stdcall DestroyEncoder() {
+	int __stdcall SetMarkerLog(int encoderHandle, const char* logPath)
+	{
+		std::shared_ptr<Encoder> encoder = encoders.Get(encoderHandle);
+
+		if (encoder != nullptr)
+		{
+			encoder->SetMarkerLog(logPath != NULL ? std::string(logPath) : std::string());
+
+			//Generated frames only carry markers while somebody reads them.
+			frameMarkers = logPath != NULL && logPath[0] != 0;
+			if (currentAPI != NULL)
+			{
+				currentAPI->SetFrameMarkers(frameMarkers);
+			}
+			return 0;
+		}
+
+		return -1;
+	}
+
+	int __stdcall AddRendition(int encoderHandle, const char* videoPath, int width, int height, int bitrate)
+	{
+		std::shared_ptr<Encoder> encoder = encoders.Get(encoderHandle);
+
 		if (encoder != nullptr)
 		{
-			delete encoder;
-			encoder = nullptr;
+			return encoder->AddRendition(std::string(videoPath), width, height, bitrate);
+		}
+
+		return -1;
+	}
+
+	int __stdcall ClearRenditions(int encoderHandle)
+	{
+		std::shared_ptr<Encoder> encoder = encoders.Get(encoderHandle);
 
+		if (encoder != nullptr)
+		{
+			encoder->ClearRenditions();
 			return 0;
 		}
 
 		return -1;
 	}
 
-	int __stdcall StartEncoding(int inputWidth, int inputHeight, int outputWidth, int outputHeight, int inputFramerate)
+	int __stdcall SetParallelGopMode(int encoderHandle, int chunkFrames, int workerCount, int memoryLimitMB)
+	{
+		std::shared_ptr<Encoder> encoder = encoders.Get(encoderHandle);
+
+		if (encoder != nullptr)
+		{
+			return encoder->SetParallelGopMode(chunkFrames, workerCount, memoryLimitMB);
+		}
+
+		return -1;
+	}
+
+	int __stdcall SetTimestampMode(int encoderHandle, int mode)
+	{
+		std::shared_ptr<Encoder> encoder = encoders.Get(encoderHandle);
+
+		if (encoder != nullptr)
+		{
+			return encoder->SetTimestampMode(mode == 1 ? TimestampCFR : TimestampVFR);
+		}
+
+		return -1;
+	}
+
+	int __stdcall StartEncoding(int encoderHandle, int inputWidth, int inputHeight, int outputWidth, int outputHeight, int inputFramerate)
 	{
+		std::shared_ptr<Encoder> encoder = encoders.Get(encoderHandle);
+
 		if (encoder != nullptr)
 		{
 			return encoder->StartEncoding(inputWidth, inputHeight, outputWidth, outputHeight, inputFramerate);
@@ -71,8 +171,10 @@ extern "C" {
 		return -1;
 	}
 
-	int __stdcall StopEncoding()
+	int __stdcall StopEncoding(int encoderHandle)
 	{
+		std::shared_ptr<Encoder> encoder = encoders.Get(encoderHandle);
+
 		if (encoder != nullptr)
 		{
 			return encoder->StopEncoding();
@@ -81,8 +183,25 @@ extern "C" {
 		return -1;
 	}
 
-	int __stdcall EncodeFrames(int maxFrames)
+	int __stdcall StopEncodingAsync(int encoderHandle, StopCallback callback)
 	{
+		std::shared_ptr<Encoder> encoder = encoders.Get(encoderHandle);
+
+		if (encoder != nullptr)
+		{
+			//The stop thread keeps the encoder alive, DestroyEncoder right after this does not wait for it.
+			return encoder->StopEncodingAsync([encoder, encoderHandle, callback](int result, const EncodeResult &stats) {
+				if (callback != NULL) callback(encoderHandle, result, stats.frames, stats.bytes, stats.durationUs);
+			});
+		}
+
+		return -1;
+	}
+
+	int __stdcall EncodeFrames(int encoderHandle, int maxFrames)
+	{
+		std::shared_ptr<Encoder> encoder = encoders.Get(encoderHandle);
+
 		if (encoder != nullptr)
 		{
 			return encoder->EncodeFrames(maxFrames);
@@ -91,15 +210,144 @@ extern "C" {
 		return -1;
 	}
 
+	int __stdcall RequestKeyframe(int encoderHandle)
+	{
+		std::shared_ptr<Encoder> encoder = encoders.Get(encoderHandle);
+
+		if (encoder != nullptr)
+		{
+			encoder->RequestKeyframe();
+			return 0;
+		}
+
+		return -1;
+	}
+
+	int __stdcall SetSceneCutThreshold(int encoderHandle, int threshold)
+	{
+		std::shared_ptr<Encoder> encoder = encoders.Get(encoderHandle);
+
+		if (encoder != nullptr)
+		{
+			encoder->SetSceneCutThreshold(threshold);
+			return 0;
+		}
+
+		return -1;
+	}
+
+	int __stdcall SetCaptureRegion(int encoderHandle, int x, int y, int width, int height)
+	{
+		std::shared_ptr<Encoder> encoder = encoders.Get(encoderHandle);
+
+		if (encoder != nullptr)
+		{
+			encoder->SetCaptureRegion(x, y, width, height);
+			return 0;
+		}
+
+		return -1;
+	}
+
+	int __stdcall SetLiveMode(int encoderHandle, int enabled, int slices, NalUnitCallback callback)
+	{
+		std::shared_ptr<Encoder> encoder = encoders.Get(encoderHandle);
+
+		if (encoder != nullptr)
+		{
+			return encoder->SetLiveMode(enabled != 0, slices, callback);
+		}
+
+		return -1;
+	}
+
+	int __stdcall SetQuality(int encoderHandle, const char* preset, int crf)
+	{
+		std::shared_ptr<Encoder> encoder = encoders.Get(encoderHandle);
+
+		if (encoder != nullptr)
+		{
+			return encoder->SetQuality(preset != NULL ? std::string(preset) : std::string(), crf);
+		}
+
+		return -1;
+	}
+
+	int __stdcall GetLatency(int encoderHandle, int64_t* lastUs, int64_t* averageUs, int64_t* maxUs)
+	{
+		std::shared_ptr<Encoder> encoder = encoders.Get(encoderHandle);
+
+		if (encoder != nullptr)
+		{
+			encoder->GetLatency(lastUs, averageUs, maxUs);
+			return 0;
+		}
+
+		return -1;
+	}
+
+	int __stdcall GetFrameIntervals(int encoderHandle, int64_t* meanUs, int64_t* p50Us, int64_t* p99Us, int64_t* maxUs)
+	{
+		std::shared_ptr<Encoder> encoder = encoders.Get(encoderHandle);
+
+		if (encoder != nullptr)
+		{
+			encoder->GetFrameIntervals(meanUs, p50Us, p99Us, maxUs);
+			return 0;
+		}
+
+		return -1;
+	}
+
+	int __stdcall GetEncoderStats(int encoderHandle, EncoderStats* stats)
+	{
+		std::shared_ptr<Encoder> encoder = encoders.Get(encoderHandle);
+
+		if (encoder != nullptr)
+		{
+			encoder->GetStats(stats);
+			return 0;
+		}
+
+		return -1;
+	}
+
+	int __stdcall SetAudioFormat(int encoderHandle, int sampleRate, int channels)
+	{
+		std::shared_ptr<Encoder> encoder = encoders.Get(encoderHandle);
+
+		if (encoder != nullptr)
+		{
+			encoder->SetAudioFormat(sampleRate, channels);
+			return 0;
+		}
+
+		return -1;
+	}
+
+	int __stdcall InsertAudio(int encoderHandle, const float* samples, int numSamples)
+	{
+		std::shared_ptr<Encoder> encoder = encoders.Get(encoderHandle);
+
+		if (encoder != nullptr)
+		{
+			return encoder->InsertAudio(samples, numSamples);
+		}
+
+		return -1;
+	}
+
 	int __stdcall CreateMuxer(const char* videoFile, const char* audioFile) {
-		muxer = new Muxer(std::string(videoFile), std::string(audioFile));
+		Muxer *muxer = new Muxer(std::string(videoFile), std::string(audioFile));
 		muxer->SetDebugPath(debugPath);
 		muxer->SetDebugLog(debugLog);
 
-		return 0;
+		return muxers.Add(muxer);
 	}
 
-	int __stdcall StartMuxing(const char* outputFile) {
+	int __stdcall StartMuxing(int muxerHandle, const char* outputFile) {
+		std::shared_ptr<Muxer> muxer = muxers.Get(muxerHandle);
+
 		if (muxer != nullptr) {
 			return muxer->startMuxing(std::string(outputFile));
 		}
@@ -107,23 +355,25 @@ extern "C" {
 		return -1;
 	}
 
-	int __stdcall DestroyMuxer() {
-		if (muxer != nullptr) {
-			delete muxer;
-			muxer = nullptr;
+	int __stdcall DestroyMuxer(int muxerHandle) {
+		if (muxers.Remove(muxerHandle)) {
 			return 0;
 		}
 
 		return -1;
 	}
 
-	void __stdcall StartCapturing(int _width, int _height)
+	void __stdcall StartCapturing(int encoderHandle, int _width, int _height)
 	{
 		if (currentAPI != NULL)
 		{
+			//Hold on to the encoder so destroying its handle cannot pull it away from the render thread.
+			capturingEncoder = encoders.Get(encoderHandle);
+
 			currentAPI->SetDebugCallback(debugLog);
 			currentAPI->SetDebugPath(debugPath);
-			currentAPI->SetExternalEncoder(encoder);
+			currentAPI->SetExternalEncoder(capturingEncoder.get());
+			currentAPI->SetTargetFramerate(capturingEncoder != nullptr ? capturingEncoder->GetFramerate() : 0);
 
 			currentAPI->StartCapturing(_width, _height);
 		}
@@ -132,7 +382,30 @@ extern "C" {
 	void  __stdcall StopCapturing()
 	{
 		if (currentAPI != NULL)
+		{
 			currentAPI->StopCapturing();
+			currentAPI->SetExternalEncoder(nullptr);
+		}
+
+		capturingEncoder.reset();
+	}
+
+	int64_t __stdcall GetSkippedCaptureFrames()
+	{
+		if (currentAPI != NULL)
+		{
+			return currentAPI->GetSkippedFrames();
+		}
+
+		return 0;
+	}
+
+	void __stdcall SetReadbackDepth(int depth)
+	{
+		if (currentAPI != NULL)
+		{
+			currentAPI->SetReadbackDepth(depth);
+		}
 	}
 
 	int64_t __stdcall GetHighresTime()
@@ -157,6 +430,9 @@ extern "C" {
 	{
 		unityGraphics->UnregisterDeviceEventCallback(OnGraphicsDeviceEvent);
 		OnGraphicsDeviceEvent(kUnityGfxDeviceEventShutdown);
+
+		//The formatter thread must not outlive the library.
+		Logger::Shutdown();
 	}
 }
 
@@ -166,7 +442,26 @@ static void UNITY_INTERFACE_API OnGraphicsDeviceEvent(UnityGfxDeviceEventType ev
 	{
 		assert(currentAPI == NULL);
 		deviceType = unityGraphics->GetRenderer();
-		currentAPI = CreateRenderAPI(deviceType);
+
+		//Opt in for tests and batch runs: SCREENRECORDER_SYNTHETIC_CAPTURE=<gpu latency in us> captures generated frames
+		//instead of the graphics device, whatever the device is.
+		const char *synthetic = getenv("SCREENRECORDER_SYNTHETIC_CAPTURE");
+
+		if (synthetic != NULL)
+		{
+			extern RenderAPI* CreateRenderAPI_Synthetic(int gpuLatencyUs);
+			currentAPI = CreateRenderAPI_Synthetic(atoi(synthetic));
+			if (debugLog != NULL) debugLog("Capturing synthetic frames");
+		}
+		else
+		{
+			currentAPI = CreateRenderAPI(deviceType);
+		}
+
+		if (currentAPI != NULL)
+		{
+			currentAPI->SetFrameMarkers(frameMarkers);
+		}
 	}
 
 	if (currentAPI != NULL)
@@ -186,6 +481,7 @@ static void UNITY_INTERFACE_API OnRenderEvent(int eventID)
 {
 	if (currentAPI != NULL)
 	{
+		TRACE_SCOPE("ReadFrameBuffer", -1);
 		currentAPI->ReadFrameBuffer();
 	}
 	else
@@ -6,6 +6,7 @@
 #include <windows.h>
 #include <stdlib.h>
 #include "SystemCallbacks.h"
+#include "EncoderStats.h"
 
 extern "C" {
 	#include "libavutil/mathematics.h"
@@ -31,25 +32,91 @@ extern "C" {
 
 	SCREENRECORDER_INTERFACE void __stdcall SetDebugPath(const char* path);
 
+	//Returns an opaque encoder handle that every other encoder call takes, or -1 on failure.
+	//Different handles can be driven from different threads at the same time.
 	SCREENRECORDER_INTERFACE int __stdcall CreateEncoder(const char* videoPath, int codec, int width, int height, int framerate, int bitrate, int iframeInterval);
 
-	SCREENRECORDER_INTERFACE int __stdcall DestroyEncoder();
+	SCREENRECORDER_INTERFACE int __stdcall DestroyEncoder(int encoderHandle);
 
-	SCREENRECORDER_INTERFACE int __stdcall StartEncoding(int inputWidth, int inputHeight, int outputWidth, int outputHeight, int inputFramerate);
+	SCREENRECORDER_INTERFACE int __stdcall SetOutputFile(int encoderHandle, const char* videoPath);
 
-	SCREENRECORDER_INTERFACE int __stdcall StopEncoding();
+	//Records a Chrome trace of every pipeline stage per frame for the next recordings, written to tracePath when the stream is finished.
+	//Opens in chrome://tracing or ui.perfetto.dev. Empty or NULL turns it off, only one encoder should trace at a time.
+	SCREENRECORDER_INTERFACE int __stdcall SetTraceFile(int encoderHandle, const char* tracePath);
 
-	SCREENRECORDER_INTERFACE int __stdcall EncodeFrames(int maxFrames);
+	//Logs the frame marker of every inserted frame and the write time of every packet for the next recordings, written to logPath
+	//when the stream is finished. LatencyVerifier turns it and the output file into per-frame latency. Empty or NULL turns it off.
+	SCREENRECORDER_INTERFACE int __stdcall SetMarkerLog(int encoderHandle, const char* logPath);
 
+	//Extra outputs at other resolutions, added before StartEncoding. The file extension picks the codec.
+	SCREENRECORDER_INTERFACE int __stdcall AddRendition(int encoderHandle, const char* videoPath, int width, int height, int bitrate);
+
+	SCREENRECORDER_INTERFACE int __stdcall ClearRenditions(int encoderHandle);
+
+	//Offline captures: encode chunks of chunkFrames concurrently, 0 turns it off. Set before StartEncoding, fails in live mode.
+	SCREENRECORDER_INTERFACE int __stdcall SetParallelGopMode(int encoderHandle, int chunkFrames, int workerCount, int memoryLimitMB);
+
+	//0 keeps capture timestamps (VFR), 1 places frames on a fixed 1/framerate grid (CFR). Set before StartEncoding.
+	SCREENRECORDER_INTERFACE int __stdcall SetTimestampMode(int encoderHandle, int mode);
+
+	SCREENRECORDER_INTERFACE int __stdcall StartEncoding(int encoderHandle, int inputWidth, int inputHeight, int outputWidth, int outputHeight, int inputFramerate);
+
+	SCREENRECORDER_INTERFACE int __stdcall StopEncoding(int encoderHandle);
+
+	//Returns right away, the queued frames, flush and trailer are written on a background thread.
+	//The callback runs on that thread with the result and the frames, bytes and duration of the file.
+	SCREENRECORDER_INTERFACE int __stdcall StopEncodingAsync(int encoderHandle, StopCallback callback);
+
+	SCREENRECORDER_INTERFACE int __stdcall EncodeFrames(int encoderHandle, int maxFrames);
+
+	//Makes the next encoded frame a keyframe, e.g. at a chapter point. Safe to call from any thread.
+	SCREENRECORDER_INTERFACE int __stdcall RequestKeyframe(int encoderHandle);
+
+	//Mean luma change between frames that counts as a scene cut, 0 turns detection off.
+	SCREENRECORDER_INTERFACE int __stdcall SetSceneCutThreshold(int encoderHandle, int threshold);
+
+	//Encode only part of the capture, in top-down pixels. Takes effect on the next frame with a keyframe, zero size captures everything.
+	SCREENRECORDER_INTERFACE int __stdcall SetCaptureRegion(int encoderHandle, int x, int y, int width, int height);
+
+	//Zerolatency tuning with intra refresh, split into the given number of slices. After each frame is encoded its NAL units go to the
+	//callback one by one, lastUnit set on the final one, before the packet is muxed. The SPS and PPS come ahead of the first frame and
+	//of every keyframe. Set before StartEncoding, fails in parallel gop mode.
+	SCREENRECORDER_INTERFACE int __stdcall SetLiveMode(int encoderHandle, int enabled, int slices, NalUnitCallback callback);
+
+	//x264 preset (NULL keeps ultrafast) and constant quality instead of the bitrate, the x264 crf or the mpeg4 qscale, 0 turns it off.
+	//Set before StartEncoding.
+	SCREENRECORDER_INTERFACE int __stdcall SetQuality(int encoderHandle, const char* preset, int crf);
+
+	//Capture to packet latency in microseconds for the current recording.
+	SCREENRECORDER_INTERFACE int __stdcall GetLatency(int encoderHandle, int64_t* lastUs, int64_t* averageUs, int64_t* maxUs);
+
+	//Spacing of the inserted frame timestamps in microseconds for the current recording.
+	SCREENRECORDER_INTERFACE int __stdcall GetFrameIntervals(int encoderHandle, int64_t* meanUs, int64_t* p50Us, int64_t* p99Us, int64_t* maxUs);
+
+	//Counters, drops by reason and per stage timings since StartEncoding. Lock free, cheap enough to call every frame.
+	SCREENRECORDER_INTERFACE int __stdcall GetEncoderStats(int encoderHandle, EncoderStats* stats);
+
+	SCREENRECORDER_INTERFACE int __stdcall SetAudioFormat(int encoderHandle, int sampleRate, int channels);
+
+	SCREENRECORDER_INTERFACE int __stdcall InsertAudio(int encoderHandle, const float* samples, int numSamples);
+
+	//Returns an opaque muxer handle, or -1 on failure.
 	SCREENRECORDER_INTERFACE int __stdcall CreateMuxer(const char* videoFile, const char* audioFile);
 
-	SCREENRECORDER_INTERFACE int __stdcall StartMuxing(const char* outputFile);
+	SCREENRECORDER_INTERFACE int __stdcall StartMuxing(int muxerHandle, const char* outputFile);
 
-	SCREENRECORDER_INTERFACE int __stdcall DestroyMuxer();
+	SCREENRECORDER_INTERFACE int __stdcall DestroyMuxer(int muxerHandle);
 
-	SCREENRECORDER_INTERFACE void __stdcall StartCapturing(int _width, int _height);
+	SCREENRECORDER_INTERFACE void __stdcall StartCapturing(int encoderHandle, int _width, int _height);
 
 	SCREENRECORDER_INTERFACE void  __stdcall StopCapturing();
 
+	//Render events since StartCapturing that were not read back because no frame was due yet.
+	SCREENRECORDER_INTERFACE int64_t __stdcall GetSkippedCaptureFrames();
+
+	//Frames a readback may stay in flight on asynchronous backends, set before StartCapturing.
+	SCREENRECORDER_INTERFACE void __stdcall SetReadbackDepth(int depth);
+
+	//Milliseconds on a monotonic clock, the same clock the capturers stamp frames with.
 	SCREENRECORDER_INTERFACE int64_t __stdcall GetHighresTime();
 }
@@ -8,6 +8,7 @@
 
 #include "RenderAPI.h"
 #include "TimeTools.h"
+#include "Logger.h"
 #include <atomic>
 #include <d3d9.h>
 #include <map>
@@ -72,13 +73,16 @@ void RenderAPI_D3D9::ReadFrameBuffer()
 {
 	if (!isCapturing) return;
 
+	//Rendering faster than we encode, leave this frame on the GPU.
+	if (!pacer.IsFrameDue(timenow_ns())) return;
+
 	DWORD* surfaceData;
 	IDirect3DSurface9* pRenderTargetOne = NULL;
 
 	//Get the render target surface.
 	if (FAILED(_device->GetRenderTarget(0, &pRenderTarget)))
 	{
-		if (debugLog != NULL) debugLog("Faild to get Render Target");
+		LOG_WARN(debugLog, "Faild to get Render Target");
 		SAFE_RELEASE(pRenderTarget);
 		return;
 	}
@@ -90,7 +94,7 @@ void RenderAPI_D3D9::ReadFrameBuffer()
 	{
 		if (FAILED(_device->CreateRenderTarget(currentWidth, currentHeight, sd.Format, D3DMULTISAMPLE_NONE, 0, TRUE, &pRenderTargetOne, NULL)))
 		{
-			if (debugLog != NULL) debugLog("Faild to create non multisampled surface");
+			LOG_WARN(debugLog, "Faild to create non multisampled surface");
 			SAFE_RELEASE(pRenderTarget);
 			SAFE_RELEASE(pRenderTargetOne);
 			return;
@@ -98,7 +102,7 @@ void RenderAPI_D3D9::ReadFrameBuffer()
 
 		if (FAILED(_device->StretchRect(pRenderTarget, NULL, pRenderTargetOne, NULL, D3DTEXF_NONE)))
 		{
-			if (debugLog != NULL) debugLog("Faild to StretchRect");
+			LOG_WARN(debugLog, "Faild to StretchRect");
 			SAFE_RELEASE(pRenderTarget);
 			SAFE_RELEASE(pRenderTargetOne);
 			return;
@@ -119,7 +123,7 @@ void RenderAPI_D3D9::ReadFrameBuffer()
 		&pDestTarget,
 		NULL)))
 	{
-		if (debugLog != NULL) debugLog("Faild to create offscreenSurface");
+		LOG_WARN(debugLog, "Faild to create offscreenSurface");
 		SAFE_RELEASE(pDestTarget);
 		return;
 	}
@@ -127,7 +131,7 @@ void RenderAPI_D3D9::ReadFrameBuffer()
 
 	if (FAILED(_device->GetRenderTargetData(pRenderTarget, pDestTarget)))
 	{
-		if (debugLog != NULL) debugLog("Faild to get RenderTargetData.");
+		LOG_WARN(debugLog, "Faild to get RenderTargetData.");
 		
 		return;
 	}
@@ -161,24 +165,24 @@ void RenderAPI_D3D9::ReadFrameBuffer()
 			}
 		}
 
-		int64_t timenow = timenow_ms();
-		int64_t timeStamp = timenow - startTime;
+		//Microseconds on the monotonic clock since capture started.
+		int64_t timeStamp = (timenow_ns() - startTime) / 1000;
 
 		if (m_encoder != nullptr)
 		{
-			m_encoder->InsertFrame(imageData, 4, frameCount == 0 ? 0 : timeStamp);
+			m_encoder->InsertFrameUs(imageData, 4, 0, frameCount == 0 ? 0 : timeStamp);
 		}
 
 		frameCount++;
 
 		if (FAILED(pDestTarget->UnlockRect())) 
 		{
-			if (debugLog != NULL) debugLog("Failed to unlock...");
+			LOG_WARN(debugLog, "Failed to unlock...");
 		}
 	}
 	else
 	{
-		if (debugLog != NULL)  debugLog("NOT LOCKABLE");
+		LOG_WARN(debugLog, "NOT LOCKABLE");
 	}
 
 	// clean up.
@@ -191,7 +195,7 @@ void RenderAPI_D3D9::StartCapturing(int _width, int _height)
 {
 	currentWidth = _width;
 	currentHeight = _height;
-	startTime = timenow_ms();
+	startTime = timenow_ns();
 	frameCount = 0;
 	isCapturing = true;
 	imageData = new BYTE[_width*_height*4];
@@ -37,6 +37,14 @@ AACEncoder::~AACEncoder(){
     if (fifo)
         av_audio_fifo_free(fifo);
 
+    if (convertedSamples) {
+        av_freep(&convertedSamples[0]);
+        av_freep(&convertedSamples);
+    }
+
+    av_frame_free(&inputFrame);
+    av_frame_free(&outputFrame);
+
     swr_free(&resample_context);
 
     if (outputCodecContext)
@@ -285,21 +293,24 @@ int AACEncoder::decode_audio_frame(AVFrame *frame,
     return 0;
 }
 
-int AACEncoder::init_converted_samples(uint8_t ***converted_input_samples,
-                                  AVCodecContext *output_codec_context,
-                                  int frame_size)
+int AACEncoder::ensure_converted_capacity(AVCodecContext *output_codec_context, int frame_size)
 {
     int error;
 
-    if (!(*converted_input_samples = (uint8_t**)calloc(output_codec_context->channels, sizeof(**converted_input_samples)))) {
-        if (debugLog != NULL) debugLog("Could not allocate converted input sample pointers");
-        return AVERROR(ENOMEM);
+    if (frame_size <= convertedCapacity) {
+        return 0;
+    }
+
+    if (convertedSamples) {
+        av_freep(&convertedSamples[0]);
+        av_freep(&convertedSamples);
     }
 
-    if ((error = av_samples_alloc(*converted_input_samples, NULL,
-                                  output_codec_context->channels,
-                                  frame_size,
-                                  output_codec_context->sample_fmt, 0)) < 0) {
+    int linesize;
+    if ((error = av_samples_alloc_array_and_samples(&convertedSamples, &linesize,
+                                                    output_codec_context->channels,
+                                                    frame_size,
+                                                    output_codec_context->sample_fmt, 0)) < 0) {
         
         if (debugLog != NULL)
         {
@@ -308,10 +319,11 @@ int AACEncoder::init_converted_samples(uint8_t ***converted_input_samples,
             debugLog(buffer);
         }
         
-        av_freep(&(*converted_input_samples)[0]);
-        free(*converted_input_samples);
+        convertedCapacity = 0;
         return error;
     }
+
+    convertedCapacity = frame_size;
     return 0;
 }
 
@@ -367,54 +379,39 @@ int AACEncoder::read_decode_convert_and_store(AVAudioFifo *fifo,
                                          SwrContext *resampler_context,
                                          int *finished)
 {
-    //Temporary storage of the input samples of the frame read from the file.
-    AVFrame *input_frame = NULL;
-    //Temporary storage for the converted input samples.
-    uint8_t **converted_input_samples = NULL;
     int data_present;
-    int ret = AVERROR_EXIT;
 
-    if (init_input_frame(&input_frame))
-        goto cleanup;
+    //The decoder unreferences the previous samples of the frame, so one frame serves every read.
+    if (inputFrame == NULL && init_input_frame(&inputFrame))
+        return AVERROR_EXIT;
     
-    if (decode_audio_frame(input_frame, input_format_context,
+    if (decode_audio_frame(inputFrame, input_format_context,
                            input_codec_context, &data_present, finished))
-        goto cleanup;
+        return AVERROR_EXIT;
     
 	//Check for error or end.
     if (*finished && !data_present) {
-        ret = 0;
-        goto cleanup;
+        return 0;
     }
 
     //If there is decoded data, convert and store it
     if (data_present) {
-        //Initialize the temporary storage for the converted input samples. */
-        if (init_converted_samples(&converted_input_samples, output_codec_context,
-                                   input_frame->nb_samples))
-            goto cleanup;
+        //Grows the storage for the converted input samples when a larger frame comes in.
+        if (ensure_converted_capacity(output_codec_context, inputFrame->nb_samples))
+            return AVERROR_EXIT;
 
         //Convert the input samples to the desired output sample format.
-        if (convert_samples((const uint8_t**)input_frame->extended_data, converted_input_samples,
-                            input_frame->nb_samples, resampler_context))
-            goto cleanup;
+        if (convert_samples((const uint8_t**)inputFrame->extended_data, convertedSamples,
+                            inputFrame->nb_samples, resampler_context))
+            return AVERROR_EXIT;
 
         // Add the converted input samples to the FIFO buffer for later processing.
-        if (add_samples_to_fifo(fifo, converted_input_samples,
-                                input_frame->nb_samples))
-            goto cleanup;
-        ret = 0;
+        if (add_samples_to_fifo(fifo, convertedSamples,
+                                inputFrame->nb_samples))
+            return AVERROR_EXIT;
     }
-    ret = 0;
 
-    cleanup:
-    if (converted_input_samples) {
-        av_freep(&converted_input_samples[0]);
-        free(converted_input_samples);
-    }
-    av_frame_free(&input_frame);
-
-    return ret;
+    return 0;
 }
 
 int AACEncoder::init_output_frame(AVFrame **frame,
@@ -504,29 +501,27 @@ int AACEncoder::load_encode_and_write(AVAudioFifo *fifo,
                                  AVFormatContext *output_format_context,
                                  AVCodecContext *output_codec_context)
 {
-    //Temporary storage of the output samples of the frame written to the file.
-    AVFrame *output_frame;
     const int frame_size = FFMIN(av_audio_fifo_size(fifo),
                                  output_codec_context->frame_size);
     int data_written;
 
-    //Initialize temporary storage for one output frame.
-    if (init_output_frame(&output_frame, output_codec_context, frame_size))
+    //Storage for one full codec frame, the last frame of the stream only uses part of it.
+    if (outputFrame == NULL && init_output_frame(&outputFrame, output_codec_context, output_codec_context->frame_size))
         return AVERROR_EXIT;
 
-    if (av_audio_fifo_read(fifo, (void **)output_frame->data, frame_size) < frame_size) {
+    //The codec copies the samples in, the buffer is free again once encode returns.
+    outputFrame->nb_samples = frame_size;
+
+    if (av_audio_fifo_read(fifo, (void **)outputFrame->data, frame_size) < frame_size) {
         if (debugLog != NULL) debugLog("Could not read data from FIFO");
-        av_frame_free(&output_frame);
         return AVERROR_EXIT;
     }
 
     //Encode one frame worth of audio samples.
-    if (encode_audio_frame(output_frame, output_format_context, output_codec_context, &data_written)) {
-        av_frame_free(&output_frame);
+    if (encode_audio_frame(outputFrame, output_format_context, output_codec_context, &data_written)) {
         return AVERROR_EXIT;
     }
 
-    av_frame_free(&output_frame);
     return 0;
 }
 
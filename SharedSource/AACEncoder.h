@@ -35,6 +35,12 @@ class AACEncoder {
     AVAudioFifo *fifo = NULL;
     int ret = AVERROR_EXIT;
 
+    //Reused for every audio frame, allocated on first use so encoding allocates nothing per frame.
+    AVFrame *inputFrame = NULL;
+    AVFrame *outputFrame = NULL;
+    uint8_t **convertedSamples = NULL;
+    int convertedCapacity = 0;
+
     int open_input(const char *filename,
                    AVFormatContext **input_format_context,
                    AVCodecContext **input_codec_context);
@@ -44,9 +50,11 @@ class AACEncoder {
                          AVCodecContext **output_codec_context,
                          AVStream **audio_stream);
 
+    //Per instance so encoders running on different threads never share the buffer.
+    char error_buffer[255];
+
     const char *get_error_text(const int error)
     {
-        static char error_buffer[255];
         av_strerror(error, error_buffer, sizeof(error_buffer));
         return error_buffer;
     }
@@ -59,9 +67,7 @@ class AACEncoder {
                                   AVFormatContext *input_format_context,
                                   AVCodecContext *input_codec_context,
                                   int *data_present, int *finished);
-    int init_converted_samples(uint8_t ***converted_input_samples,
-                                      AVCodecContext *output_codec_context,
-                                      int frame_size);
+    int ensure_converted_capacity(AVCodecContext *output_codec_context, int frame_size);
     int convert_samples(const uint8_t **input_data,
                                uint8_t **converted_data, const int frame_size,
                                SwrContext *resample_context);
@@ -0,0 +1,358 @@
+#include "AudioStreamEncoder.h"
+#include "Logger.h"
+
+AudioStreamEncoder::AudioStreamEncoder(int inputSampleRate, int inputChannels, LogCallback callback)
+{
+    sampleRate = inputSampleRate;
+    channels = inputChannels;
+    debugLog = callback;
+}
+
+AudioStreamEncoder::~AudioStreamEncoder()
+{
+    if (debugLog != NULL) debugLog("Destroying audio stream encoder!");
+
+    CloseStream();
+
+    if (fifo) {
+        av_audio_fifo_free(fifo);
+        fifo = NULL;
+    }
+
+    if (convertedSamples) {
+        av_freep(&convertedSamples[0]);
+        av_freep(&convertedSamples);
+        convertedCapacity = 0;
+    }
+
+    av_frame_free(&outputFrame);
+    swr_free(&resample_context);
+}
+
+int AudioStreamEncoder::AddStream(AVFormatContext *context)
+{
+    AVCodec *output_codec = NULL;
+    int error;
+
+    targetContext = context;
+    audioPTS = 0;
+
+    //Find the encoder to be used by its name.
+    if (!(output_codec = avcodec_find_encoder(AV_CODEC_ID_AAC))) {
+        if (debugLog != NULL) debugLog("Could not find an AAC encoder.");
+        return -1;
+    }
+
+    //Create a new audio stream next to the video stream in the output container.
+    if (!(audioStream = avformat_new_stream(targetContext, output_codec))) {
+        if (debugLog != NULL) debugLog("Could not create new audio stream.");
+        return -1;
+    }
+
+    //The aac encoder keeps overlap from the previous frames, so every recording gets a fresh codec.
+    //Resampler, fifo and sample buffers stay allocated between recordings.
+    outputCodecContext = avcodec_alloc_context3(output_codec);
+    outputCodecContext->channels       = channels;
+    outputCodecContext->channel_layout = av_get_default_channel_layout(channels);
+    outputCodecContext->sample_rate    = sampleRate;
+    outputCodecContext->sample_fmt     = output_codec->sample_fmts[0];
+    outputCodecContext->bit_rate       = 96000;
+    outputCodecContext->time_base.num  = 1;
+    outputCodecContext->time_base.den  = sampleRate;
+
+    //Allow the use of the experimental AAC encoder
+    outputCodecContext->strict_std_compliance = FF_COMPLIANCE_EXPERIMENTAL;
+
+    //Set the sample rate for the container.
+    audioStream->time_base.num = 1;
+    audioStream->time_base.den = sampleRate;
+
+    if (targetContext->oformat->flags & AVFMT_GLOBALHEADER) {
+        if (debugLog != NULL) debugLog("Add separate audio stream headers");
+
+        outputCodecContext->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+
+    if ((error = avcodec_open2(outputCodecContext, output_codec, NULL)) < 0) {
+        if (debugLog != NULL)
+        {
+            char buffer [256];
+            snprintf(buffer, 256, "Could not open output audio codec (error '%s')", get_error_text(error));
+            debugLog(buffer);
+        }
+
+        avcodec_free_context(&outputCodecContext);
+        return -1;
+    }
+
+    //The stream only describes the codec for the muxer.
+    if (avcodec_copy_context(audioStream->codec, outputCodecContext) < 0) {
+        if (debugLog != NULL) debugLog("Failed to copy audio codec parameters to output stream");
+        return -1;
+    }
+    audioStream->codec->codec_tag = 0;
+
+    if (resample_context == NULL && init_resampler() < 0) {
+        return -1;
+    }
+
+    if (outputFrame == NULL && init_output_frame() < 0) {
+        return -1;
+    }
+
+    //Create the FIFO buffer based on the specified output sample format.
+    if (fifo == NULL && !(fifo = av_audio_fifo_alloc(outputCodecContext->sample_fmt, outputCodecContext->channels, outputCodecContext->frame_size))) {
+        if (debugLog != NULL) debugLog("Could not allocate audio FIFO");
+        return -1;
+    }
+
+    //Drop anything the host sent before the stream existed, it would be ahead of the first video frame.
+    std::lock_guard<std::mutex> lock(inputLock);
+    pendingSamples.clear();
+
+    return 0;
+}
+
+int AudioStreamEncoder::init_resampler()
+{
+    int error;
+
+    resample_context = swr_alloc_set_opts(NULL,
+                                          av_get_default_channel_layout(outputCodecContext->channels),
+                                          outputCodecContext->sample_fmt,
+                                          outputCodecContext->sample_rate,
+                                          av_get_default_channel_layout(channels),
+                                          AV_SAMPLE_FMT_FLT,
+                                          sampleRate,
+                                          0, NULL);
+    if (!resample_context) {
+        if (debugLog != NULL) debugLog("Could not allocate resample context.");
+        return AVERROR(ENOMEM);
+    }
+
+    if ((error = swr_init(resample_context)) < 0) {
+        if (debugLog != NULL) debugLog("Could not init resample context.");
+        swr_free(&resample_context);
+        return error;
+    }
+
+    return 0;
+}
+
+int AudioStreamEncoder::init_output_frame()
+{
+    int error;
+
+    if (!(outputFrame = av_frame_alloc())) {
+        if (debugLog != NULL) debugLog("Could not allocate output audio frame");
+        return AVERROR(ENOMEM);
+    }
+
+    outputFrame->nb_samples     = outputCodecContext->frame_size;
+    outputFrame->channel_layout = outputCodecContext->channel_layout;
+    outputFrame->format         = outputCodecContext->sample_fmt;
+    outputFrame->sample_rate    = outputCodecContext->sample_rate;
+
+    if ((error = av_frame_get_buffer(outputFrame, 0)) < 0) {
+        if (debugLog != NULL)
+        {
+            char buffer [256];
+            snprintf(buffer, 256, "Could allocate output audio frame samples (error '%s')", get_error_text(error));
+            debugLog(buffer);
+        }
+
+        av_frame_free(&outputFrame);
+        return error;
+    }
+
+    return 0;
+}
+
+int AudioStreamEncoder::ensure_converted_capacity(int frame_size)
+{
+    if (frame_size <= convertedCapacity) {
+        return 0;
+    }
+
+    if (convertedSamples) {
+        av_freep(&convertedSamples[0]);
+        av_freep(&convertedSamples);
+    }
+
+    int linesize;
+    if (av_samples_alloc_array_and_samples(&convertedSamples, &linesize, outputCodecContext->channels, frame_size, outputCodecContext->sample_fmt, 0) < 0) {
+        if (debugLog != NULL) debugLog("Could not allocate converted audio samples");
+        convertedCapacity = 0;
+        return AVERROR(ENOMEM);
+    }
+
+    convertedCapacity = frame_size;
+    return 0;
+}
+
+int AudioStreamEncoder::InsertSamples(const float *samples, int numSamples)
+{
+    if (numSamples <= 0) {
+        return 0;
+    }
+
+    //Interleaved input, numSamples is counted per channel.
+    std::lock_guard<std::mutex> lock(inputLock);
+    pendingSamples.insert(pendingSamples.end(), samples, samples + numSamples * channels);
+
+    return 0;
+}
+
+int AudioStreamEncoder::convert_pending_samples()
+{
+    {
+        //Swap out the pending samples so the audio thread is never blocked by the conversion.
+        std::lock_guard<std::mutex> lock(inputLock);
+        workingSamples.swap(pendingSamples);
+    }
+
+    int frame_size = (int)(workingSamples.size() / channels);
+    int error = 0;
+
+    if (frame_size > 0) {
+        int out_samples = swr_get_out_samples(resample_context, frame_size);
+
+        if ((error = ensure_converted_capacity(out_samples)) < 0) {
+            workingSamples.clear();
+            return error;
+        }
+
+        const uint8_t *input_data[1] = { (const uint8_t*)workingSamples.data() };
+        int converted = swr_convert(resample_context, convertedSamples, out_samples, input_data, frame_size);
+
+        if (converted < 0) {
+            LOG_ERROR(debugLog, "Could not convert input audio samples (error '{}')", get_error_text(converted));
+
+            error = converted;
+        }
+        else if (converted > 0 && av_audio_fifo_write(fifo, (void **)convertedSamples, converted) < converted) {
+            LOG_ERROR(debugLog, "Could not write data to audio FIFO");
+            error = AVERROR_EXIT;
+        }
+    }
+
+    workingSamples.clear();
+    return error;
+}
+
+int AudioStreamEncoder::encode_audio_frame(AVFrame *frame, int *data_present)
+{
+    AVPacket output_packet;
+    int error;
+    av_init_packet(&output_packet);
+    output_packet.data = NULL;
+    output_packet.size = 0;
+
+    if (frame) {
+        frame->pts = audioPTS;
+        audioPTS += frame->nb_samples;
+    }
+
+    if ((error = avcodec_encode_audio2(outputCodecContext, &output_packet, frame, data_present)) < 0) {
+        LOG_ERROR(debugLog, "Could not encode audio frame (error '{}')", get_error_text(error));
+
+        av_packet_unref(&output_packet);
+        return error;
+    }
+
+    if (*data_present)
+    {
+        //The muxer interleaves this with the video packets written by the encoder.
+        output_packet.stream_index = audioStream->index;
+        av_packet_rescale_ts(&output_packet, outputCodecContext->time_base, audioStream->time_base);
+
+        if ((error = av_interleaved_write_frame(targetContext, &output_packet)) < 0) {
+            LOG_ERROR(debugLog, "Could not write audio frame (error '{}')", get_error_text(error));
+
+            return error;
+        }
+    }
+
+    return 0;
+}
+
+int AudioStreamEncoder::load_encode_and_write(int frame_size)
+{
+    int data_written;
+
+    outputFrame->nb_samples = frame_size;
+
+    if (av_audio_fifo_read(fifo, (void **)outputFrame->data, frame_size) < frame_size) {
+        LOG_ERROR(debugLog, "Could not read data from audio FIFO");
+        return AVERROR_EXIT;
+    }
+
+    return encode_audio_frame(outputFrame, &data_written);
+}
+
+int AudioStreamEncoder::EncodeAudio()
+{
+    if (outputCodecContext == NULL) {
+        return -1;
+    }
+
+    if (convert_pending_samples() < 0) {
+        return -1;
+    }
+
+    //Only full frames are encoded while recording, the remainder waits for more samples.
+    const int output_frame_size = outputCodecContext->frame_size;
+
+    while (av_audio_fifo_size(fifo) >= output_frame_size) {
+        if (load_encode_and_write(output_frame_size) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int AudioStreamEncoder::Flush()
+{
+    if (outputCodecContext == NULL) {
+        return -1;
+    }
+
+    if (EncodeAudio() < 0) {
+        return -1;
+    }
+
+    //The last partial frame is allowed to be short.
+    int remaining = av_audio_fifo_size(fifo);
+    if (remaining > 0 && load_encode_and_write(remaining) < 0) {
+        return -1;
+    }
+
+    //Flush the encoder as it may have delayed frames.
+    int data_written = 0;
+    do
+    {
+        if (encode_audio_frame(NULL, &data_written) < 0)
+        {
+            return -1;
+        }
+    } while (data_written);
+
+    if (debugLog != NULL) debugLog("End of live audio!");
+
+    return 0;
+}
+
+void AudioStreamEncoder::CloseStream()
+{
+    if (fifo) {
+        av_audio_fifo_reset(fifo);
+    }
+
+    if (outputCodecContext) {
+        avcodec_free_context(&outputCodecContext);
+    }
+
+    audioStream = NULL;
+    targetContext = NULL;
+}
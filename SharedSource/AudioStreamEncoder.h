@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <stdio.h>
+#include "SystemCallbacks.h"
+
+extern "C" {
+    #include "libavformat/avformat.h"
+    #include "libavcodec/avcodec.h"
+    #include "libavutil/audio_fifo.h"
+    #include "libavutil/frame.h"
+    #include "libavutil/opt.h"
+    #include "libswresample/swresample.h"
+}
+
+//Encodes live interleaved float pcm into an aac stream owned by the video encoders format context.
+//Unlike AACEncoder this never reads from disk, samples are pushed from the host while recording.
+//The same instance is reused for consecutive recordings, AddStream/CloseStream bracket each file.
+class AudioStreamEncoder {
+    LogCallback debugLog;
+    int sampleRate;
+    int channels;
+    int64_t audioPTS = 0;
+
+    AVFormatContext *targetContext = NULL;
+    AVCodecContext *outputCodecContext = NULL;
+    AVStream *audioStream = NULL;
+    SwrContext *resample_context = NULL;
+    AVAudioFifo *fifo = NULL;
+    AVFrame *outputFrame = NULL;
+
+    //Converted samples, grown on demand and reused between calls.
+    uint8_t **convertedSamples = NULL;
+    int convertedCapacity = 0;
+
+    //Samples handed over by the host, guarded since they arrive on the audio thread.
+    std::mutex inputLock;
+    std::vector<float> pendingSamples;
+    std::vector<float> workingSamples;
+
+    //Per instance so encoders running on different threads never share the buffer.
+    char error_buffer[255];
+
+    const char *get_error_text(const int error)
+    {
+        av_strerror(error, error_buffer, sizeof(error_buffer));
+        return error_buffer;
+    }
+
+    int init_resampler();
+    int init_output_frame();
+    int ensure_converted_capacity(int frame_size);
+    int convert_pending_samples();
+    int encode_audio_frame(AVFrame *frame, int *data_present);
+    int load_encode_and_write(int frame_size);
+
+public:
+    AudioStreamEncoder(int inputSampleRate, int inputChannels, LogCallback callback);
+    ~AudioStreamEncoder();
+
+    int AddStream(AVFormatContext *context);
+    int InsertSamples(const float *samples, int numSamples);
+    int EncodeAudio();
+    int Flush();
+    void CloseStream();
+};
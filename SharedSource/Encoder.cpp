@@ -4,8 +4,56 @@
 
 #include "Encoder.h"
 #include <inttypes.h>
+#include <mutex>
 #include "DebugTools.h"
+#include "TimeTools.h"
 #include "RGB2YUV420.h"
+#include "Logger.h"
+#include "Tracer.h"
+#include "FrameMarker.h"
+
+static std::once_flag registerOnce;
+
+//Hands every NAL unit of an annex b packet to the callback, start code included. Runs once the whole frame is encoded,
+//so the units of a frame arrive together and the split only saves the receiver from parsing start codes.
+//endsFrame is off for the parameter sets sent ahead of a frame, so lastUnit stays on the frame's final unit.
+static void emit_nal_units(NalUnitCallback callback, const uint8_t *data, int size, int64_t ptsUs, int keyframe, bool endsFrame)
+{
+    //Each unit ends where the next start code is found, data that is not annex b like mpeg4 is passed on whole.
+    int unitStart = 0;
+    
+    for (int i = 0; i + 2 < size; i++)
+    {
+        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1)
+        {
+            int start = i > 0 && data[i - 1] == 0 ? i - 1 : i;
+            
+            if (start > unitStart)
+            {
+                callback(data + unitStart, start - unitStart, ptsUs, keyframe, 0);
+                unitStart = start;
+            }
+            
+            i += 2;
+        }
+    }
+    
+    callback(data + unitStart, size - unitStart, ptsUs, keyframe, endsFrame ? 1 : 0);
+}
+
+static void RegisterCodecs()
+{
+    std::call_once(registerOnce, []() {
+        //Initialize all muxers/demuxers
+        av_register_all();
+        
+        //Register all available codecs.
+        avcodec_register_all();
+        
+        //Detect device hardware to allow for set_opt
+        av_get_cpu_flags();
+    });
+}
 
 Encoder::Encoder(std::string videoFile, CapturingCodec codec, int encodeBitrate, int iframeinterval, bool flipVertical)
 {
@@ -13,41 +61,78 @@ Encoder::Encoder(std::string videoFile, CapturingCodec codec, int encodeBitrate,
 	this->captureCodec = codec;
     this->bitrate = encodeBitrate;
     this->iframeinterval = iframeinterval;
+    this->framerate = 0;
     this->flipV = flipVertical;
 	this->captureCodec = codec;
     
     debugLog = NULL;
     encodeStream = nullptr;
-    encode_frame = nullptr;
-    frame_data = nullptr;
-    framePool = nullptr;
-    flippedPixelBuffer = nullptr;
-    frameScaleConverter = nullptr;
-    rescaleFrame = nullptr;
+    session = nullptr;
+    picturePool = nullptr;
+    lastPicture = nullptr;
+    lastSharedPicture = nullptr;
+    parallelEncoder = nullptr;
+    timestampMode = TimestampVFR;
+    sceneCutThreshold = 0;
+    lastCaptureTimestamp = AV_NOPTS_VALUE;
+    captureRegion.x = 0;
+    captureRegion.y = 0;
+    captureRegion.width = 0;
+    captureRegion.height = 0;
+    encodedWidth = 0;
+    encodedHeight = 0;
+    pixelOrder = PixelOrderRGBA;
+    liveMode = false;
+    liveSlices = 0;
+    constantQuality = 0;
+    nalCallback = NULL;
+    nalHeadersSent = false;
+    lastLatency = 0;
+    maxLatency = 0;
+    totalLatency = 0;
+    latencyFrames = 0;
+    gopChunkFrames = 0;
+    gopWorkers = 0;
+    gopMemoryLimitMB = 0;
+    audioEncoder = nullptr;
+    audioSampleRate = 0;
+    audioChannels = 0;
+    endOfStream = false;
+    packetsWritten = 0;
+    writtenUntilUs = 0;
+    tracing = false;
+    markerLogging = false;
+    
+    //Fixed up front so the queues never allocate while recording. The pool bounds the frame queue,
+    //capture times only pile up as deep as the codec delays frames.
+    processingFrames.Reserve(20);
+    captureTimes.Reserve(256);
+    ResetStats();
 }
 
 Encoder::~Encoder() {
+    WaitForStop();
+    ClearRenditions();
+    ReleaseSession();
+    
     if (debugLog != NULL) debugLog("Destroyed encoder!");
 }
 
 int Encoder::StartEncoding(int inputWidth, int inputHeight, int outputWidth, int outputHeight, int inputFramerate) 
 {
+    //A recording still finishing in the background owns the codec until it is done.
+    WaitForStop();
+    
 	this->width = inputWidth;
 	this->height = inputHeight;
 	this->framerate = inputFramerate;
 
     if (debugLog != NULL) debugLog("Start encoding");
     
-    //Initialize all muxers/demuxers
-    av_register_all();
-    
-    //Register all available codecs.
-    avcodec_register_all();
-    
-    //Detect device hardware to allow for set_opt
-    av_get_cpu_flags();
+    RegisterCodecs();
     
-    this->encodeStream = OpenOutputFile(videoFile.c_str());
+    AVCodecID codecIds[] = { AV_CODEC_ID_H264, AV_CODEC_ID_MPEG4, AV_CODEC_ID_GIF };
+    this->encodeStream = OpenVideoOutput(videoFile.c_str(), debugLog, codecIds[captureCodec]);
     
     if (encodeStream == nullptr) {
         if (debugLog != NULL) debugLog("Unable to setup output encoder");
@@ -55,13 +140,108 @@ int Encoder::StartEncoding(int inputWidth, int inputHeight, int outputWidth, int
         return -1;
     }
     
-    //Set codec options.
-    if (ConfigureOutputVideo(this->encodeStream, outputWidth, outputHeight) < 0) {
-        if (debugLog != NULL) debugLog("Unable to configure video output");
+    bool globalHeader = (encodeStream->formatContext->oformat->flags & AVFMT_GLOBALHEADER) != 0;
+    AVRational timeBase = TimestampEngine::CodecTimeBase(timestampMode, encodeStream->codec->id, framerate);
+    
+    //Reuse the warm session when the previous recording had the same geometry, otherwise start over.
+    if (session != nullptr && session->Matches(encodeStream->codec, inputWidth, inputHeight, outputWidth, outputHeight, framerate, bitrate, globalHeader, timeBase))
+    {
+        if (debugLog != NULL) debugLog("Reusing warm encoder session");
+        
+        if (session->drained && OpenSessionCodec(session) < 0)
+        {
+            if (debugLog != NULL) debugLog("Unable to reopen output video codec");
+        }
+    }
+    else
+    {
+        ReleaseSession();
+        session = CreateSession(encodeStream->codec, inputWidth, inputHeight, outputWidth, outputHeight, globalHeader, timeBase);
+        
+        if (session == nullptr)
+        {
+            CloseVideoOutput(encodeStream, debugLog);
+            encodeStream = nullptr;
+            return -1;
+        }
     }
     
-    if (OpenOutputVideoCodec(this->encodeStream) < 0) {
-        if (debugLog != NULL) debugLog("Unable to open output video codec");
+    session->BeginRecording();
+    timestamps.Reset(timestampMode, framerate, session->codecContext->time_base);
+    //In live mode intra refresh takes over from periodic idr frames.
+    keyframes.Configure(liveMode ? 0 : iframeinterval, sceneCutThreshold);
+    keyframes.Reset();
+    encodedWidth = 0;
+    encodedHeight = 0;
+    lastPicture = nullptr;
+    nalHeadersSent = false;
+    
+    captureTimes.clear();
+    frameIntervals.Reset();
+    lastCaptureTimestamp = AV_NOPTS_VALUE;
+    lastLatency = 0;
+    maxLatency = 0;
+    totalLatency = 0;
+    latencyFrames = 0;
+    packetsWritten = 0;
+    writtenUntilUs = 0;
+    ResetStats();
+    endOfStream = false;
+    
+    //The stream only describes the session codec context, it is never opened itself.
+    AVStream *videoStream = encodeStream->stream;
+    if (avcodec_copy_context(videoStream->codec, session->codecContext) < 0)
+    {
+        if (debugLog != NULL) debugLog("Failed to copy codec parameters to output stream");
+    }
+    videoStream->codec->codec_tag = 0;
+    videoStream->time_base = session->codecContext->time_base;
+    
+    //Independent codec contexts per worker with the session rate control, each chunk is one gop.
+    if (gopChunkFrames > 0)
+    {
+        VideoCodecSettings settings;
+        settings.width = session->outputWidth;
+        settings.height = session->outputHeight;
+        settings.framerate = session->framerate;
+        settings.bitrate = session->bitrate;
+        settings.globalHeader = session->globalHeader;
+        settings.timeBase = session->timeBase;
+        settings.gopSize = 0;
+        settings.lowLatency = false;
+        settings.slices = 0;
+        settings.preset = codecPreset.empty() ? NULL : codecPreset.c_str();
+        settings.crf = constantQuality;
+        
+        parallelEncoder = new ParallelGopEncoder(session->codec, &settings, session->codecContext->pix_fmt,
+                                                 gopChunkFrames, gopWorkers, gopMemoryLimitMB, debugLog);
+        
+        //Every packet comes from a worker, the file header has to describe their streams and not the session codec's.
+        if (parallelEncoder->CopyExtradata(videoStream->codec) < 0)
+        {
+            if (debugLog != NULL) debugLog("Unable to copy parallel gop stream headers");
+        }
+        
+        parallelEncoder->Start([this](AVPacket *packet) {
+            packet->stream_index = encodeStream->stream->index;
+            return WritePacket(packet);
+        });
+    }
+    
+    //Audio has to be part of the format context before the header is written.
+    if (audioSampleRate > 0 && audioChannels > 0)
+    {
+        if (audioEncoder == nullptr)
+        {
+            audioEncoder = new AudioStreamEncoder(audioSampleRate, audioChannels, debugLog);
+        }
+        
+        if (audioEncoder->AddStream(encodeStream->formatContext) < 0)
+        {
+            if (debugLog != NULL) debugLog("Unable to add live audio stream, recording video only");
+            delete audioEncoder;
+            audioEncoder = nullptr;
+        }
     }
     
     //Open output file for writing.
@@ -75,193 +255,421 @@ int Encoder::StartEncoding(int inputWidth, int inputHeight, int outputWidth, int
         return 1;
     }
     
-    //Pool to hold our incoming raw rgba frames.
-    int bufferSize = width * height * 4;
-    framePool = new FramePool(10, bufferSize);
+    //Every rendition downscales from the same converted picture, so conversion runs once per frame.
+    if (!renditions.empty())
+    {
+        picturePool = new PicturePool(4, inputWidth, inputHeight);
+        
+        for (size_t i = 0; i < renditions.size(); i++)
+        {
+            if (renditions[i]->Start(framerate, session->codecContext->gop_size, session->codecContext->time_base, timestampMode) < 0)
+            {
+                if (debugLog != NULL) debugLog("Unable to start rendition, it will be skipped");
+                delete renditions[i];
+                renditions.erase(renditions.begin() + i);
+                i--;
+            }
+        }
+    }
     
-    //This is the main frame we convert and fill from the capturer output.
-    int numBytes = avpicture_get_size(AV_PIX_FMT_YUV420P, width, height);
-    frame_data = (uint8_t *)av_malloc(numBytes * sizeof(uint8_t));
-    encode_frame = av_frame_alloc();
-    avpicture_fill((AVPicture *)encode_frame, frame_data, AV_PIX_FMT_YUV420P, width, height);
-    encode_frame->format = AV_PIX_FMT_YUV420P;
-    encode_frame->width = width;
-    encode_frame->height = height;
+    if (!traceFile.empty())
+    {
+        Tracer::Start();
+        tracing = true;
+    }
     
-    if (debugLog != NULL)
+    if (!markerLogFile.empty())
     {
-        char buffer [100];
-        snprintf(buffer, 100, "Data size: %d", numBytes);
-        debugLog(buffer);
+        std::lock_guard<std::mutex> lock(markerLock);
+        markerInserts.clear();
+        markerWrites.clear();
+        markerLogging = true;
     }
     
-	if (inputWidth != outputWidth || inputHeight != outputHeight)
-	{
-		AVCodecContext *outputContext = this->encodeStream->stream->codec;
-		rescaleFrame = av_frame_alloc();
-		rescaleFrame->format = outputContext->pix_fmt;
-		rescaleFrame->width = outputWidth;
-		rescaleFrame->height = outputHeight;
-		av_image_alloc(rescaleFrame->data, rescaleFrame->linesize, outputWidth, outputHeight, outputContext->pix_fmt, 1);
-		frameScaleConverter = sws_getContext(width, height, AV_PIX_FMT_YUV420P, outputWidth, outputHeight, outputContext->pix_fmt, SWS_BILINEAR, NULL, NULL, NULL);
-	
-		isRescaled = true;
-	}
+    if (debugLog != NULL) debugLog("Encoder is ready!");
     
-    //Init tracking variables.
-    frameCount = 0;
-    codecTime = 0;
+    return 0;
+}
+
+int Encoder::StopEncoding() 
+{
+    WaitForStop();
     
-    if (flipV){
-        flippedPixelBuffer = (uint8_t*)malloc(width * height * 4);
+    if (encodeStream == nullptr)
+    {
+        return -1;
     }
-    else
+    
+    endOfStream = true;
+    
+    return FinishEncoding(nullptr);
+}
+
+int Encoder::StopEncodingAsync(std::function<void(int, const EncodeResult&)> completion)
+{
+    WaitForStop();
+    
+    if (encodeStream == nullptr)
     {
-        flippedPixelBuffer = nullptr;
+        return -1;
     }
     
-    if (debugLog != NULL) debugLog("Encoder is ready!");
+    //The stream ends here, whatever is queued is encoded on the stop thread and later frames are dropped.
+    endOfStream = true;
+    
+    stopThread = std::thread([this, completion]() {
+        TRACE_THREAD_NAME("StopEncoding");
+        EncodeResult result;
+        int status = FinishEncoding(&result);
+        
+        if (completion)
+        {
+            completion(status, result);
+        }
+    });
     
     return 0;
 }
 
-int Encoder::StopEncoding() 
-{    
+void Encoder::WaitForStop()
+{
+    if (!stopThread.joinable())
+    {
+        return;
+    }
+    
+    //Called from the completion callback the stop thread can not wait for itself.
+    if (stopThread.get_id() == std::this_thread::get_id())
+    {
+        stopThread.detach();
+        return;
+    }
+    
+    stopThread.join();
+}
+
+int Encoder::FinishEncoding(EncodeResult *result)
+{
     if (debugLog != NULL) debugLog("Stop encoding");
     
+    std::lock_guard<std::mutex> encoding(encodeLock);
+    
     //Encode the remaining cached frames.
-    if (debugLog != NULL)
+    LOG_INFO(debugLog, "Encoding cached frames {}", processingFrames.size());
+    
+    EncodeQueuedFrames(INT_MAX);
+    
+    LOG_INFO(debugLog, "Frame interval us: mean {}, p50 {}, p99 {}, max {}",
+             frameIntervals.Mean(), frameIntervals.Percentile(50), frameIntervals.Percentile(99), frameIntervals.Max());
+    
+    if (parallelEncoder != nullptr)
     {
-        char buffer [100];
-        snprintf(buffer, 100, "Encoding cached frames %u", processingFrames.size());
-        debugLog(buffer);
+        //Waits for the chunks still being encoded and writes them in order.
+        parallelEncoder->Flush();
+        delete parallelEncoder;
+        parallelEncoder = nullptr;
     }
+    else
+    {
+        flush_encoder(session->codecContext);
+    }
+    session->drained = true;
     
-    EncodeFrames(processingFrames.size());
-
-    //Protect us against division by zero errors.
-    if (frameCount == 0)
+    if (audioEncoder != nullptr)
     {
-        frameCount = 1;
+        audioEncoder->Flush();
     }
     
-    int64_t averagePTS = codecTime / frameCount;
+    av_write_trailer(encodeStream->formatContext);
     
-    if (debugLog != NULL)
+    if (result != nullptr)
     {
-        char buffer [100];
-        snprintf(buffer, 100, "Average pts: %lld", averagePTS);
-        debugLog(buffer);
+        result->frames = packetsWritten;
+        result->bytes = encodeStream->formatContext->pb != nullptr ? avio_size(encodeStream->formatContext->pb) : 0;
+        result->durationUs = writtenUntilUs;
     }
     
-    flush_encoder(encodeStream->formatContext, encodeStream->stream->index, averagePTS);
-    
-    //Clear all memory for buffered images.
-    delete framePool;
+    //Waits for each rendition to encode its queued pictures and close its file.
+    for (size_t i = 0; i < renditions.size(); i++)
+    {
+        renditions[i]->Stop();
+    }
     
-    av_write_trailer(encodeStream->formatContext);
+    if (lastSharedPicture != nullptr)
+    {
+        picturePool->Release(lastSharedPicture);
+        lastSharedPicture = nullptr;
+    }
+    lastPicture = nullptr;
     
-    if (encodeStream->stream){
-
-        if (debugLog != NULL) debugLog("Closing output video codec");
-
-        avcodec_close(encodeStream->stream->codec);
+    if (picturePool != nullptr)
+    {
+        delete picturePool;
+        picturePool = nullptr;
     }
     
-    if (encodeStream->formatContext){
-        AVFormatContext *outputContext = encodeStream->formatContext;
+    CloseOutputFile();
+    
+    //Frames inserted while the stream was ending go back to the pool, the warm session hands them out again.
+    {
+        std::lock_guard<std::mutex> lock(frameLock);
         
-        if (debugLog != NULL) debugLog("Free output streams");
+        while (!processingFrames.empty())
+        {
+            session->framePool->pushFrame(processingFrames.front());
+            processingFrames.pop();
+        }
+    }
+    
+    if (tracing)
+    {
+        tracing = false;
         
-        int i;
-        for (i = 0; i < outputContext->nb_streams; i++) {
-            av_freep(&outputContext->streams[i]->codec);
-            av_freep(&outputContext->streams[i]);
+        if (Tracer::Stop(traceFile.c_str()) < 0)
+        {
+            if (debugLog != NULL) debugLog("Unable to write trace file");
         }
+    }
+    
+    if (markerLogging)
+    {
+        markerLogging = false;
         
-        if (debugLog != NULL) debugLog("Close output file");
-        avio_close(outputContext->pb);
+        if (WriteMarkerLog() < 0)
+        {
+            if (debugLog != NULL) debugLog("Unable to write marker log");
+        }
+    }
+
+    return 0;
+}
+
+void Encoder::CloseOutputFile()
+{
+    //Audio keeps its resampler and fifo, only the per file codec is closed.
+    if (audioEncoder != nullptr)
+    {
+        audioEncoder->CloseStream();
+    }
+    
+    CloseVideoOutput(encodeStream, debugLog);
+    encodeStream = nullptr;
+}
+
+void Encoder::ReleaseSession()
+{
+    WaitForStop();
+    
+    if (session != nullptr)
+    {
+        if (debugLog != NULL) debugLog("Releasing encoder session");
         
-        if (debugLog != NULL) debugLog("Free output context");
-        av_free(outputContext);
+        delete session;
+        session = nullptr;
     }
     
-    //Free size conversion data.
-    sws_freeContext(frameScaleConverter);
-    av_freep(&rescaleFrame->data[0]);
-    av_frame_free(&rescaleFrame);
+    if (audioEncoder != nullptr)
+    {
+        delete audioEncoder;
+        audioEncoder = nullptr;
+    }
+}
+
+EncoderSession* Encoder::CreateSession(AVCodec *codec, int inputWidth, int inputHeight, int outputWidth, int outputHeight, bool globalHeader, AVRational timeBase)
+{
+    EncoderSession *target = new EncoderSession(codec, inputWidth, inputHeight, outputWidth, outputHeight, framerate, bitrate, globalHeader, timeBase);
     
-    if (debugLog != NULL) debugLog("Free yuv buffer data");
-    av_free(frame_data);
+    if (OpenSessionCodec(target) < 0) {
+        if (debugLog != NULL) debugLog("Unable to open output video codec");
+    }
     
-    if (debugLog != NULL) debugLog("free yuv frame");
-    av_frame_free(&encode_frame);
+    int numBytes = target->AllocateBuffers();
     
-    if (flippedPixelBuffer)
+    if (numBytes < 0)
     {
-        free(flippedPixelBuffer);
-        flippedPixelBuffer = nullptr;
+        if (debugLog != NULL) debugLog("Unable to allocate encoder buffers");
+        delete target;
+        return nullptr;
     }
     
-	std::queue <FrameObject_t*>().swap(processingFrames);
+    if (debugLog != NULL)
+    {
+        char buffer [100];
+        snprintf(buffer, 100, "Data size: %d", numBytes);
+        debugLog(buffer);
+    }
+    
+    return target;
+}
 
-    return 0;
+int Encoder::OpenSessionCodec(EncoderSession *target)
+{
+    if (target->codecContext != nullptr)
+    {
+        avcodec_free_context(&target->codecContext);
+    }
+    
+    target->codecContext = avcodec_alloc_context3(target->codec);
+    target->drained = false;
+    
+    VideoCodecSettings settings;
+    settings.width = target->outputWidth;
+    settings.height = target->outputHeight;
+    settings.framerate = target->framerate;
+    settings.bitrate = target->bitrate;
+    settings.globalHeader = target->globalHeader;
+    settings.timeBase = target->timeBase;
+    
+    //Keyframes are placed by time, the codec interval is only a fallback well past it.
+    settings.gopSize = iframeinterval > 0 ? iframeinterval * target->framerate * 2 : 0;
+    
+    //The refresh wave sweeps the picture once per gop, once a second is enough for joining viewers.
+    settings.lowLatency = liveMode;
+    settings.slices = liveSlices;
+    settings.preset = codecPreset.empty() ? NULL : codecPreset.c_str();
+    settings.crf = constantQuality;
+    if (liveMode)
+    {
+        settings.gopSize = target->framerate;
+    }
+    
+    //Set codec options.
+    if (ConfigureVideoCodec(target->codecContext, target->codec, &settings, debugLog) < 0) {
+        if (debugLog != NULL) debugLog("Unable to configure video output");
+    }
+    
+    return OpenVideoCodec(target->codecContext, target->codec, debugLog);
 }
 
 int Encoder::EncodeFrames(int maxFrames) 
+{
+    std::lock_guard<std::mutex> encoding(encodeLock);
+    
+    //After the end of stream the stop thread drains the queue, checked under the lock so a stop waits for this call.
+    if (endOfStream)
+    {
+        return 0;
+    }
+    
+    return EncodeQueuedFrames(maxFrames);
+}
+
+int Encoder::EncodeQueuedFrames(int maxFrames) 
 {    
+    TRACE_SCOPE("EncodeFrames", -1);
+    
     //Regulates how many frames per step we are allowed to encode.
     int framesEncoded = 0;
     
-    while (processingFrames.size() > 0) {
+    while (framesEncoded < maxFrames) {
         
-        if (framesEncoded >= maxFrames) {
-            break;
+        FrameObject_t *raw_frame = nullptr;
+        
+        {
+            std::lock_guard<std::mutex> lock(frameLock);
+            
+            if (processingFrames.empty()) {
+                break;
+            }
+            
+            raw_frame = processingFrames.front();
+            processingFrames.pop();
         }
         
-        FrameObject_t *raw_frame = processingFrames.front();
-        processingFrames.pop();
+        //Slots the capture skipped keep showing the previous picture, it is still in place until this frame is converted.
+        if (lastPicture != nullptr)
+        {
+            for (int i = raw_frame->gap; i > 0; i--)
+            {
+                EncodePicture(lastPicture, raw_frame->pts - i, false, -1);
+            }
+        }
         
-        uint8_t *rgbaFrame = nullptr;
+        AVFrame *encode_frame = session->encode_frame;
+        int frameWidth = raw_frame->width;
+        int frameHeight = raw_frame->height;
         
-        if (flipV)
+        //A new region starts a new picture for the decoder, so it gets a keyframe.
+        if (frameWidth != encodedWidth || frameHeight != encodedHeight)
         {
-            uint8_t *rawframe = raw_frame->frame;
-            
-            for (int y=0; y < height; y++)
+            if (encodedWidth != 0)
             {
-                for (int x=0; x < width; x++)
-                {
-                    flippedPixelBuffer[(y*width+x)*4+0] = rawframe[((height-1-y)*width+x)*4+0];
-                    flippedPixelBuffer[(y*width+x)*4+1] = rawframe[((height-1-y)*width+x)*4+1];
-                    flippedPixelBuffer[(y*width+x)*4+2] = rawframe[((height-1-y)*width+x)*4+2];
-                    flippedPixelBuffer[(y*width+x)*4+3] = rawframe[((height-1-y)*width+x)*4+3];
-                }
+                session->forceKeyframe = true;
             }
             
-            rgbaFrame = flippedPixelBuffer;
+            session->PrepareScaler(frameWidth, frameHeight);
+            encodedWidth = frameWidth;
+            encodedHeight = frameHeight;
+        }
+        
+        AVFrame *rescaleFrame = session->rescaleFrame;
+
+        //With renditions the conversion goes into a shared picture that every output reads from.
+        SharedPicture *picture = nullptr;
+        
+        if (picturePool != nullptr)
+        {
+            picture = picturePool->Acquire();
+            EncoderSession::SetPictureSize(picture->frame, picture->frame_data, frameWidth, frameHeight);
+            encode_frame = picture->frame;
         }
         else
         {
-            rgbaFrame = raw_frame->frame;
+            EncoderSession::SetPictureSize(encode_frame, session->frame_data, frameWidth, frameHeight);
+        }
+        
+        int64_t stageStart = timenow_ns();
+        
+        if (raw_frame->pixelOrder == PixelOrderBGRA)
+        {
+            bgr2yuv420(encode_frame->data[0], raw_frame->frame, 4, frameWidth, frameHeight);
+        }
+        else
+        {
+            rgb2yuv420(encode_frame->data[0], raw_frame->frame, 4, frameWidth, frameHeight);
+        }
+        
+        int64_t stageEnd = timenow_ns();
+        convertTimes.Record(stageEnd - stageStart);
+        TRACE_COMPLETE("Convert", stageStart, stageEnd, raw_frame->pts);
+        
+        //The first frame of a file must be decodable on its own.
+        int64_t frameTime = av_rescale_q(raw_frame->pts, session->codecContext->time_base, av_make_q(1, 1000000));
+        bool keyframe = keyframes.ShouldForceKeyframe(encode_frame->data[0], encode_frame->linesize[0], frameWidth, frameHeight, frameTime, session->forceKeyframe);
+        session->forceKeyframe = false;
+        
+        //Renditions repeat and force keyframes on the same slots as the main output.
+        if (picture != nullptr)
+        {
+            picture->pts = raw_frame->pts;
+            picture->gap = raw_frame->gap;
+            picture->keyframe = keyframe;
+            
+            for (size_t i = 0; i < renditions.size(); i++)
+            {
+                picturePool->Retain(picture);
+                renditions[i]->Submit(picture);
+            }
         }
-
-        rgb2yuv420(frame_data, rgbaFrame, 4, width, height);
         
         AVFrame *dstFrame = nullptr;
-        AVCodecContext *outputCodec = encodeStream->stream->codec;
         
 		//Resize input frame to match the codec size.
-        if (isRescaled)
+        if (session->isRescaled)
         {
-            sws_scale(frameScaleConverter,
+            stageStart = timenow_ns();
+            
+            sws_scale(session->frameScaleConverter,
                       (const uint8_t * const *)encode_frame->data,
                       encode_frame->linesize,
                       0,
-                      height,
+                      frameHeight,
                       rescaleFrame->data,
                       rescaleFrame->linesize);
             
+            stageEnd = timenow_ns();
+            scaleTimes.Record(stageEnd - stageStart);
+            TRACE_COMPLETE("Scale", stageStart, stageEnd, raw_frame->pts);
             dstFrame = rescaleFrame;
         }
         else
@@ -269,144 +677,259 @@ int Encoder::EncodeFrames(int maxFrames)
             dstFrame = encode_frame;
         }
         
-        dstFrame->pts = raw_frame->pts;
-        dstFrame->pict_type = AV_PICTURE_TYPE_NONE;
-        EncodeFrame(dstFrame);
+        EncodePicture(dstFrame, raw_frame->pts, keyframe, raw_frame->captureTime);
         
-		codecTime += raw_frame->pts;
-        framePool->pushFrame(raw_frame);
+        //Kept for the next gap, a shared picture stays referenced until a newer one replaces it.
+        if (lastSharedPicture != nullptr)
+        {
+            picturePool->Release(lastSharedPicture);
+        }
+        lastSharedPicture = dstFrame == encode_frame ? picture : nullptr;
+        lastPicture = dstFrame;
+        
+        if (picture != nullptr && picture != lastSharedPicture)
+        {
+            picturePool->Release(picture);
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(frameLock);
+            session->framePool->pushFrame(raw_frame);
+        }
         
-		frameCount++;
         framesEncoded++;
+        encodedFrames++;
+    }
+    
+    //Interleave whatever audio arrived since the last step.
+    if (audioEncoder != nullptr)
+    {
+        audioEncoder->EncodeAudio();
     }
     
     return 0;
 }
 
-int Encoder::flush_encoder(AVFormatContext *fmt_ctx, int stream_index, int64_t pts) {
+int Encoder::flush_encoder(AVCodecContext *codecContext) {
     int ret;
     int got_frame;
     
-    if (!(fmt_ctx->streams[stream_index]->codec->codec->capabilities & CODEC_CAP_DELAY))
+    if (!(codecContext->codec->capabilities & CODEC_CAP_DELAY))
         return 0;
     
-    int64_t currentPTS = pts;
+    //Only used when the codec does not report pts for delayed frames.
+    int64_t frameDuration = timestamps.FrameDuration();
+    int64_t currentPTS = session->lastCodecPts + frameDuration;
     
     while (1) {
         AVPacket enc_pkt;
         enc_pkt.data = NULL;
         enc_pkt.size = 0;
         av_init_packet(&enc_pkt);
-        ret = avcodec_encode_video2 (fmt_ctx->streams[stream_index]->codec, &enc_pkt, NULL, &got_frame);
+        ret = avcodec_encode_video2 (codecContext, &enc_pkt, NULL, &got_frame);
         av_frame_free(NULL);
         
         if (ret < 0){
-            if (debugLog != NULL) debugLog("Failed to flush frames");
+            LOG_ERROR(debugLog, "Failed to flush frames");
             break;
         }
         
         if (!got_frame){
             ret=0;
-            if (debugLog != NULL) debugLog("No flush frames left in codec");
+            LOG_DEBUG(debugLog, "No flush frames left in codec");
             break;
         }
         
-        if (fmt_ctx->streams[stream_index]->codec->coded_frame->key_frame) {
-            if (debugLog != NULL) debugLog("Keyframe");
+        if (codecContext->coded_frame->key_frame) {
+            LOG_DEBUG(debugLog, "Keyframe");
             enc_pkt.flags |= AV_PKT_FLAG_KEY;
         }
         
         if (enc_pkt.pts == AV_NOPTS_VALUE){
-            if (debugLog != NULL) debugLog("Setting new flush pts");
+            LOG_DEBUG(debugLog, "Setting new flush pts");
             enc_pkt.pts = currentPTS;
         }
         
-        enc_pkt.stream_index = stream_index;
+        enc_pkt.stream_index = encodeStream->stream->index;
         
-        if (debugLog != NULL)
-        {
-            char buffer [100];
-            snprintf(buffer, 100, "flush pts: %lld", enc_pkt.pts);
-            debugLog(buffer);
-            
-            snprintf(buffer, 100, "flush duration: %lld", enc_pkt.duration);
-            debugLog(buffer);
-            
-            snprintf(buffer, 100, "Flush Encoder: Succeed to encode 1 frame!\tsize:%5d",enc_pkt.size);
-            debugLog(buffer);
-        }
+        LOG_DEBUG(debugLog, "Flush Encoder: encoded 1 frame, pts {}, duration {}, size {}", enc_pkt.pts, enc_pkt.duration, enc_pkt.size);
 
-        ret = av_write_frame(fmt_ctx, &enc_pkt);
+        ret = WritePacket(&enc_pkt);
         if (ret < 0){
-            if (debugLog != NULL) debugLog("Failed to write flushed frame");
+            LOG_ERROR(debugLog, "Failed to write flushed frame");
             break;
         }
         
         //Simulated delay between frames.
-        currentPTS += pts;
+        currentPTS += frameDuration;
     }
     
     return ret;
 }
 
 int Encoder::InsertFrame(uint8_t *frame, int bytesPerPixel, int64_t timeStamp){
-    
-	AVRational timeScale;
-	timeScale.num = 1;
-	timeScale.den = 1000;
+    return InsertFrameUs(frame, bytesPerPixel, 0, timeStamp * 1000);
+}
 
-    int64_t pts = av_rescale_q(timeStamp, timeScale, encodeStream->stream->time_base);
+int Encoder::InsertFrameUs(uint8_t *frame, int, int stride, int64_t timeStampUs){
+    
+    TRACE_FRAME_SCOPE("InsertFrame");
+    insertedFrames++;
+    
+    if (markerLogging)
+    {
+        LogInsertMarker(frame, stride);
+    }
+    
+    if (endOfStream) {
+        droppedEndOfStream++;
+        return 0;
+    }
+    
+    if (lastCaptureTimestamp != AV_NOPTS_VALUE)
+    {
+        frameIntervals.Record(timeStampUs - lastCaptureTimestamp);
+    }
+    lastCaptureTimestamp = timeStampUs;
+    
+    int64_t pts = 0;
+    int gap = 0;
+    int assigned = timestamps.Assign(timeStampUs, &pts, &gap);
+    TRACE_FRAME(pts);
+    
+    //CFR already has a frame for this slot, skip it before paying for the copy and conversion.
+    if (assigned == 0) {
+        droppedDuplicate++;
+        return 0;
+    }
     
-    if (framePool->framesAvailable() > 0) {
-        FrameObject_t *freeFrame = framePool->popFrame();
-        memcpy(freeFrame->frame, frame, width * height * 4);
-        freeFrame->pts = pts;
+    FramePool *framePool = session->framePool;
+    FrameObject_t *freeFrame = nullptr;
+    CaptureRegion region;
+    CapturePixelOrder order;
+    
+    {
+        std::lock_guard<std::mutex> lock(frameLock);
         
-        processingFrames.push(freeFrame);
+        region = ResolveRegion();
+        order = pixelOrder;
+        
+        if (framePool->framesAvailable() > 0) {
+            freeFrame = framePool->popFrame();
+        }
+        else
+        {
+            //Every pooled frame is queued, the encoder is behind. Growing the pool here would put a malloc and
+            //fresh page faults on the render thread at exactly that moment, so the frame is dropped instead.
+            LOG_WARN(debugLog, "Out of frames!!!");
+        }
+    }
+    
+    //The slot is only taken once the frame is queued, a dropped frame leaves it to the next capture.
+    if (freeFrame == nullptr) {
+        droppedQueueFull++;
+        return 0;
+    }
+    
+    timestamps.Commit();
+    
+    //Copy outside the lock so the encode thread is never held up by the render thread.
+    //Only the region rows are read, bottom-up sources are flipped by copying rows in reverse.
+    int sourceStride = stride != 0 ? stride : width * 4;
+    int rowBytes = region.width * 4;
+    
+    if (!flipV && region.x == 0 && region.width == width && sourceStride == rowBytes)
+    {
+        memcpy(freeFrame->frame, frame + (ptrdiff_t)region.y * sourceStride, (size_t)rowBytes * region.height);
     }
     else
     {
-        //Dont allow an infinite size queue.
-        if (processingFrames.size() < 20)
+        for (int y = 0; y < region.height; y++)
         {
-            FrameObject_t *newFrame = (FrameObject_t*)malloc((sizeof(FrameObject_t)));
-            newFrame->frame = (uint8_t*)(malloc(width * height * 4));
-            newFrame->pts = pts;
-            
-            memcpy(newFrame->frame, frame, width * height * 4);
-            
-            processingFrames.push(newFrame);
+            int sourceRow = flipV ? height - 1 - (region.y + y) : region.y + y;
+            memcpy(freeFrame->frame + (size_t)y * rowBytes, frame + (ptrdiff_t)sourceRow * sourceStride + region.x * 4, rowBytes);
         }
-        
-        if (debugLog != NULL) debugLog("Out of frames!!!");
+    }
+    
+    freeFrame->width = region.width;
+    freeFrame->height = region.height;
+    freeFrame->pts = pts;
+    freeFrame->gap = gap;
+    freeFrame->pixelOrder = order;
+    freeFrame->captureTime = timenow_ns() / 1000;
+    
+    std::lock_guard<std::mutex> lock(frameLock);
+    processingFrames.push(freeFrame);
+    
+    if ((int64_t)processingFrames.size() > queueHighWater)
+    {
+        queueHighWater = processingFrames.size();
     }
     
     return 0;
 }
 
+CaptureRegion Encoder::ResolveRegion()
+{
+    CaptureRegion region = captureRegion;
+    
+    if (region.width <= 0 || region.height <= 0)
+    {
+        region.x = 0;
+        region.y = 0;
+        region.width = width;
+        region.height = height;
+    }
+    
+    //Keep the region inside the capture with even dimensions for 4:2:0 conversion.
+    region.x = region.x < 0 ? 0 : (region.x > width - 2 ? width - 2 : region.x);
+    region.y = region.y < 0 ? 0 : (region.y > height - 2 ? height - 2 : region.y);
+    region.width = (region.width > width - region.x ? width - region.x : region.width) & ~1;
+    region.height = (region.height > height - region.y ? height - region.y : region.height) & ~1;
+    
+    return region;
+}
+
+void Encoder::SetCaptureRegion(int x, int y, int regionWidth, int regionHeight)
+{
+    std::lock_guard<std::mutex> lock(frameLock);
+    
+    captureRegion.x = x;
+    captureRegion.y = y;
+    captureRegion.width = regionWidth;
+    captureRegion.height = regionHeight;
+}
+
+void Encoder::SetPixelOrder(CapturePixelOrder order)
+{
+    std::lock_guard<std::mutex> lock(frameLock);
+    
+    pixelOrder = order;
+}
+
 int Encoder::EncodeFrame(AVFrame *frame)
 {
-    AVCodecContext *outputCodec = encodeStream->stream->codec;
+    TRACE_SCOPE("EncodeFrame", frame->pts);
+    AVCodecContext *outputCodec = session->codecContext;
     
+    //The codec writes into the session's packet buffer instead of allocating a packet per frame.
     AVPacket pkt;
     int got_output;
     av_init_packet(&pkt);
-    pkt.data = NULL;
-    pkt.size = 0;
+    pkt.data = session->packetBuffer;
+    pkt.size = session->packetBufferSize;
+    
+    int64_t encodeStart = timenow_ns();
     
     int ret;
     ret = avcodec_encode_video2(outputCodec, &pkt, frame, &got_output);
+    int64_t encodeEnd = timenow_ns();
+    encodeTimes.Record(encodeEnd - encodeStart);
+    TRACE_COMPLETE("Encode", encodeStart, encodeEnd, frame->pts);
+    
     if (ret < 0) {
-
-        if (debugLog != NULL)
-        {
-            char error_buffer[255];
-            av_strerror(ret, error_buffer, sizeof(error_buffer));
-            
-            char buffer [100];
-            snprintf(buffer, 100, "Error encoding: %s", error_buffer);
-            debugLog(buffer);
-        }
+        char error_buffer[AV_ERROR_MAX_STRING_SIZE];
+        LOG_ERROR(debugLog, "Error encoding: {}", av_make_error_string(error_buffer, sizeof(error_buffer), ret));
 
         return -1;
     }
@@ -421,163 +944,408 @@ int Encoder::EncodeFrame(AVFrame *frame)
             pkt.flags |= AV_PKT_FLAG_KEY;
         }
         
+        TrackLatency(pkt.pts);
+        
+        if (nalCallback != NULL)
+        {
+            int64_t ptsUs = av_rescale_q(pkt.pts, outputCodec->time_base, av_make_q(1, 1000000));
+            int keyframe = (pkt.flags & AV_PKT_FLAG_KEY) ? 1 : 0;
+            
+            //With a global header the SPS and PPS only live in the extradata, a consumer needs them before the first frame
+            //and again at every keyframe or recovery point to be able to join.
+            if ((!nalHeadersSent || keyframe) && outputCodec->extradata_size > 0)
+            {
+                emit_nal_units(nalCallback, outputCodec->extradata, outputCodec->extradata_size, ptsUs, keyframe, false);
+            }
+            
+            nalHeadersSent = true;
+            emit_nal_units(nalCallback, pkt.data, pkt.size, ptsUs, keyframe, true);
+        }
+        
         pkt.stream_index = encodeStream->stream->index;
         
-        ret = av_write_frame(encodeStream->formatContext, &pkt);
+        ret = WritePacket(&pkt);
     }
     else {
-        if (debugLog != NULL) debugLog("No output for this frame");
+        LOG_DEBUG(debugLog, "No output for this frame");
         ret = 0;
     }
     
     if (ret != 0) {
-        if (debugLog != NULL) debugLog("Error while writing video frame");
+        LOG_ERROR(debugLog, "Error while writing video frame");
         return -1;
     }
     
     return 0;
 }
 
-void Encoder::SetDebugPath(std::string path) {
-    debugPath = path;
-}
-
-void Encoder::SetDebugLog(LogCallback callback){
-    debugLog = callback;
+void Encoder::EncodePicture(AVFrame *frame, int64_t pts, bool keyframe, int64_t captureTime)
+{
+    frame->pts = pts;
+    frame->pict_type = keyframe ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+    session->lastCodecPts = frame->pts;
+    
+    if (parallelEncoder != nullptr)
+    {
+        //Copied into the current chunk, which starts with its own keyframe.
+        parallelEncoder->Submit(frame);
+        return;
+    }
+    
+    //Gap copies have no capture of their own. A full ring only loses the latency sample of the oldest frame.
+    if (captureTime >= 0 && !captureTimes.push(std::make_pair(frame->pts, captureTime)))
+    {
+        captureTimes.pop();
+        captureTimes.push(std::make_pair(frame->pts, captureTime));
+    }
+    
+    EncodeFrame(frame);
 }
 
-EncodeStream* Encoder::OpenOutputFile(const char *file) {
-    AVFormatContext *outputFormatCtx = NULL;
-    int ret = avformat_alloc_output_context2(&outputFormatCtx, NULL, NULL, file);
-    if (!outputFormatCtx) {
-        if (debugLog != NULL)
+void Encoder::TrackLatency(int64_t pts)
+{
+    int64_t now = timenow_ns() / 1000;
+    
+    //Frames the codec dropped or merged never get a packet of their own.
+    while (!captureTimes.empty() && captureTimes.front().first <= pts)
+    {
+        std::pair<int64_t, int64_t> entry = captureTimes.front();
+        captureTimes.pop();
+        
+        if (entry.first == pts)
         {
-            char buffer [100];
-            snprintf(buffer, 100, "Unable to allocate output context: %s", file);
-            debugLog(buffer);
+            int64_t latency = now - entry.second;
+            
+            lastLatency = latency;
+            totalLatency += latency;
+            latencyTimes.Record(latency * 1000);
+            latencyFrames++;
+            
+            if (latency > maxLatency)
+            {
+                maxLatency = latency;
+            }
         }
     }
+}
+
+int Encoder::WritePacket(AVPacket *packet)
+{
+    int64_t framePts = packet->pts;
     
-    AVOutputFormat *outputFormat = NULL;
-    outputFormat = outputFormatCtx->oformat;
+    //The muxer may have picked its own stream time base when the header was written.
+    av_packet_rescale_ts(packet, session->codecContext->time_base, encodeStream->stream->time_base);
     
-    //Since we cant use assembly level optimization on x86 mpeg4 is actually a faster codec.
-    AVCodec *videoCodec = avcodec_find_encoder(outputFormat->video_codec);
+    packetsWritten++;
+    bytesWritten += packet->size;
+    if (packet->pts != AV_NOPTS_VALUE)
+    {
+        int64_t endUs = av_rescale_q(packet->pts + (packet->duration > 0 ? packet->duration : 0), encodeStream->stream->time_base, av_make_q(1, 1000000));
+        if (endUs > writtenUntilUs) writtenUntilUs = endUs;
+    }
+    
+    int64_t streamPts = packet->pts;
+    int64_t writeStart = timenow_ns();
+    int ret;
     
-    if (!videoCodec) {
-        if (debugLog != NULL) debugLog("Could not find video codec");
+    //With a live audio stream the muxer has to order packets by dts across both streams.
+    if (audioEncoder != nullptr)
+    {
+        ret = av_interleaved_write_frame(encodeStream->formatContext, packet);
+    }
+    else
+    {
+        ret = av_write_frame(encodeStream->formatContext, packet);
+        av_packet_unref(packet);
     }
     
-    AVStream *videoStream = avformat_new_stream(outputFormatCtx, videoCodec);
-    if (!videoStream) {
-        if (debugLog != NULL) debugLog("Could not allocate video inputStream");
+    int64_t writeEnd = timenow_ns();
+    
+    if (markerLogging)
+    {
+        std::lock_guard<std::mutex> lock(markerLock);
+        markerWrites.push_back(std::make_pair(streamPts, writeEnd / 1000));
+    }
+    writeTimes.Record(writeEnd - writeStart);
+    TRACE_COMPLETE("Write", writeStart, writeEnd, framePts);
+    
+    return ret;
+}
+
+int Encoder::AddRendition(std::string file, int outputWidth, int outputHeight, int encodeBitrate)
+{
+    if (picturePool != nullptr)
+    {
+        if (debugLog != NULL) debugLog("Renditions can not be added while encoding");
+        return -1;
     }
-    videoStream->id = 1;
     
-    EncodeStream *params = (EncodeStream*)malloc((sizeof(EncodeStream)));
-    params->formatContext = outputFormatCtx;
-    params->stream = videoStream;
-    params->codec = videoCodec;
+    renditions.push_back(new RenditionEncoder(file, outputWidth, outputHeight, encodeBitrate, debugLog));
     
-    if (debugLog != NULL)
+    return 0;
+}
+
+void Encoder::ClearRenditions()
+{
+    WaitForStop();
+    
+    for (size_t i = 0; i < renditions.size(); i++)
     {
-        if (debugLog != NULL) debugLog("Success in creating output context");
-        
-        char buffer [100];
-        snprintf(buffer, 100, "Video Codec: %s", params->codec->long_name);
-        debugLog(buffer);
+        delete renditions[i];
     }
     
-    return params;
+    renditions.clear();
 }
 
-int Encoder::ConfigureOutputVideo(EncodeStream *output, int contextWidth, int contextHeight)
+int Encoder::SetParallelGopMode(int chunkFrames, int workerCount, int memoryLimitMB)
 {
-    AVCodecContext *outputContext = output->stream->codec;
+    if (parallelEncoder != nullptr)
+    {
+        if (debugLog != NULL) debugLog("Parallel gop mode can not be changed while encoding");
+        return -1;
+    }
     
-    //Initialize the selected codec context with preferred values.
-    avcodec_get_context_defaults3(outputContext, output->codec);
+    //Chunks are encoded out of band and never reach the NAL unit callback.
+    if (chunkFrames > 0 && liveMode)
+    {
+        if (debugLog != NULL) debugLog("Parallel gop mode can not be combined with live mode");
+        return -1;
+    }
+    
+    gopChunkFrames = chunkFrames > 0 ? chunkFrames : 0;
+    gopWorkers = workerCount > 0 ? workerCount : (int)std::thread::hardware_concurrency();
+    gopMemoryLimitMB = memoryLimitMB;
     
-    outputContext->codec_id = output->codec->id;
-    outputContext->bit_rate = bitrate;
-    outputContext->width    = contextWidth;     //Resolution must be a multiple of two.
-    outputContext->height   = contextHeight;    //Resolution must be a multiple of two.
+    return 0;
+}
+
+int Encoder::SetTimestampMode(TimestampMode mode)
+{
+    if (encodeStream != nullptr)
+    {
+        if (debugLog != NULL) debugLog("Timestamp mode can not be changed while encoding");
+        return -1;
+    }
     
-    outputContext->time_base.num = 1000;
-    outputContext->time_base.den = (int)(1000.0 * (double)framerate);
-    outputContext->gop_size      = 12; /* emit one intra frame every 10 frames at most */
-    outputContext->pix_fmt       = AV_PIX_FMT_YUV420P;
-    outputContext->max_b_frames = 0;
+    timestampMode = mode;
     
-	switch (outputContext->codec_id)
-	{
-	case AV_CODEC_ID_H264:
-		outputContext->qblur = 0.0f;
-		outputContext->qmin = 18;
-		outputContext->qmax = 28;
-		//Faster encoder will result in larger output file. A slower preset will result in smaller filesize but slower encoding.
-		av_opt_set(outputContext->priv_data, "preset", "ultrafast", 0);
-		break;
-	case AV_CODEC_ID_MPEG4:
-		outputContext->qmin = 3;
-		outputContext->qmax = 10;
-		outputContext->qblur = 0.1f;
-		break;
+    return 0;
+}
 
-	case AV_CODEC_ID_GIF:
-		outputContext->gop_size = 1;
-		outputContext->bit_rate = 400000;
-		outputContext->time_base.num = 1;
-		outputContext->time_base.den = framerate;
-		outputContext->pix_fmt = AV_PIX_FMT_RGB8;
-		break;
-	}
+void Encoder::RequestKeyframe()
+{
+    keyframes.Request();
+}
+
+void Encoder::SetSceneCutThreshold(int threshold)
+{
+    //Mean luma difference between consecutive frames, 0 turns detection off.
+    sceneCutThreshold = threshold;
+}
+
+int Encoder::SetQuality(std::string preset, int crf)
+{
+    if (encodeStream != nullptr)
+    {
+        if (debugLog != NULL) debugLog("Quality can not be changed while encoding");
+        return -1;
+    }
     
-    if (outputContext->codec_id == AV_CODEC_ID_MPEG2VIDEO) {
-        outputContext->max_b_frames = 2;
-        if (debugLog != NULL) debugLog("Using AV_CODEC_ID_MPEG2VIDEO");
+    //The warm codec was opened with the old rate control.
+    if (preset != codecPreset || crf != constantQuality)
+    {
+        ReleaseSession();
     }
     
-    if (outputContext->codec_id == AV_CODEC_ID_MPEG1VIDEO) {
-        /* Needed to avoid using macroblocks in which some coeffs overflow.
-         * This does not happen with normal video, it just happens here as
-         * the motion of the chroma plane does not match the luma plane. */
-        outputContext->mb_decision = 2;
-        if (debugLog != NULL) debugLog("Using AV_CODEC_ID_MPEG1VIDEO");
+    codecPreset = preset;
+    constantQuality = crf;
+    
+    return 0;
+}
+
+int Encoder::SetLiveMode(bool enabled, int slices, NalUnitCallback callback)
+{
+    if (encodeStream != nullptr)
+    {
+        if (debugLog != NULL) debugLog("Live mode can not be changed while encoding");
+        return -1;
     }
     
-    //Some formats want inputStream headers to be separate.
-    if (output->formatContext->oformat->flags & AVFMT_GLOBALHEADER){
-        if (debugLog != NULL) debugLog("Add separate video stream headers");
-        outputContext->flags |= CODEC_FLAG_GLOBAL_HEADER;
+    if (enabled && gopChunkFrames > 0)
+    {
+        if (debugLog != NULL) debugLog("Live mode can not be combined with parallel gop mode");
+        return -1;
     }
     
+    //The warm codec was opened with the other tuning.
+    if (enabled != liveMode || slices != liveSlices)
+    {
+        ReleaseSession();
+    }
+    
+    liveMode = enabled;
+    liveSlices = slices;
+    nalCallback = enabled ? callback : NULL;
+    
     return 0;
 }
 
-int Encoder::OpenOutputVideoCodec(EncodeStream *output){
-    AVCodecContext *outputContext = output->stream->codec;
-    AVCodec *codec = output->codec;
+void Encoder::GetLatency(int64_t *lastUs, int64_t *averageUs, int64_t *maxUs)
+{
+    int64_t frames = latencyFrames;
     
-    if (debugLog != NULL)
+    if (lastUs != NULL) *lastUs = lastLatency;
+    if (averageUs != NULL) *averageUs = frames > 0 ? totalLatency / frames : 0;
+    if (maxUs != NULL) *maxUs = maxLatency;
+}
+
+int Encoder::GetFramerate()
+{
+    return framerate;
+}
+
+void Encoder::GetFrameIntervals(int64_t *meanUs, int64_t *p50Us, int64_t *p99Us, int64_t *maxUs)
+{
+    if (meanUs != NULL) *meanUs = frameIntervals.Mean();
+    if (p50Us != NULL) *p50Us = frameIntervals.Percentile(50);
+    if (p99Us != NULL) *p99Us = frameIntervals.Percentile(99);
+    if (maxUs != NULL) *maxUs = frameIntervals.Max();
+}
+
+void Encoder::GetStats(EncoderStats *stats)
+{
+    if (stats == NULL)
     {
-        char buffer [100];
-        snprintf(buffer, 100, "Opening video codec: %s", codec->long_name);
-        debugLog(buffer);
+        return;
     }
     
-    if (avcodec_open2(outputContext, codec, NULL) < 0)
+    stats->framesInserted = insertedFrames;
+    stats->framesEncoded = encodedFrames;
+    stats->droppedQueueFull = droppedQueueFull;
+    stats->droppedDuplicate = droppedDuplicate;
+    stats->droppedEndOfStream = droppedEndOfStream;
+    stats->queueHighWater = queueHighWater;
+    stats->bytesWritten = bytesWritten;
+    
+    int64_t durationUs = writtenUntilUs;
+    stats->bitrate = durationUs > 0 ? (int64_t)((double)stats->bytesWritten * 8 * 1000000 / durationUs) : 0;
+    
+    Histogram *stages[] = { &convertTimes, &scaleTimes, &encodeTimes, &writeTimes, &latencyTimes };
+    EncoderStageStats *targets[] = { &stats->convert, &stats->scale, &stats->encode, &stats->write, &stats->latency };
+    
+    for (int i = 0; i < 5; i++)
+    {
+        targets[i]->p50Ns = stages[i]->Percentile(50);
+        targets[i]->p95Ns = stages[i]->Percentile(95);
+        targets[i]->p99Ns = stages[i]->Percentile(99);
+    }
+}
+
+void Encoder::ResetStats()
+{
+    insertedFrames = 0;
+    encodedFrames = 0;
+    droppedQueueFull = 0;
+    droppedDuplicate = 0;
+    droppedEndOfStream = 0;
+    queueHighWater = 0;
+    bytesWritten = 0;
+    convertTimes.Reset();
+    scaleTimes.Reset();
+    encodeTimes.Reset();
+    writeTimes.Reset();
+    latencyTimes.Reset();
+}
+
+void Encoder::SetOutputFile(std::string file)
+{
+    videoFile = file;
+}
+
+void Encoder::SetTraceFile(std::string file)
+{
+    traceFile = file;
+}
+
+void Encoder::SetMarkerLog(std::string file)
+{
+    markerLogFile = file;
+}
+
+//The marker sits in the top rows of the picture as shown, which are the last rows of a frame that gets flipped.
+void Encoder::LogInsertMarker(const uint8_t *frame, int stride)
+{
+    int sourceStride = stride != 0 ? stride : width * 4;
+    const uint8_t *top = flipV ? frame + (ptrdiff_t)(height - 1) * sourceStride : frame;
+    uint32_t index = 0;
+    int64_t marker = frame_marker_read_rgba(top, flipV ? -sourceStride : sourceStride, width, height, &index) == 0 ? index : -1;
+    
+    std::lock_guard<std::mutex> lock(markerLock);
+    markerInserts.push_back(std::make_pair(marker, timenow_ns() / 1000));
+}
+
+//One line per event, "insert <marker> <us>" when InsertFrame was called and "write <pts> <us>" when the packet with that
+//stream pts was handed to the muxer. Frames without a readable marker log -1, times are on the timenow_ns clock.
+int Encoder::WriteMarkerLog()
+{
+    FILE *file = fopen(markerLogFile.c_str(), "w");
+    
+    if (file == NULL)
     {
-        if (debugLog != NULL) debugLog("Could not open output video codec");
         return -1;
     }
     
-    if (debugLog != NULL)
+    std::lock_guard<std::mutex> lock(markerLock);
+    
+    for (size_t i = 0; i < markerInserts.size(); i++)
     {
-        char buffer [100];
-        snprintf(buffer, 100, "Codec: %s is open", codec->long_name);
-        debugLog(buffer);
+        fprintf(file, "insert %" PRId64 " %" PRId64 "\n", markerInserts[i].first, markerInserts[i].second);
+    }
+    
+    for (size_t i = 0; i < markerWrites.size(); i++)
+    {
+        fprintf(file, "write %" PRId64 " %" PRId64 "\n", markerWrites[i].first, markerWrites[i].second);
     }
     
+    fclose(file);
+    
     return 0;
 }
+
+void Encoder::SetAudioFormat(int sampleRate, int channels)
+{
+    WaitForStop();
+    
+    //A warm audio encoder is only valid for the format it was created with.
+    if (audioEncoder != nullptr && (sampleRate != audioSampleRate || channels != audioChannels))
+    {
+        delete audioEncoder;
+        audioEncoder = nullptr;
+    }
+    
+    audioSampleRate = sampleRate;
+    audioChannels = channels;
+}
+
+int Encoder::InsertAudio(const float *samples, int numSamples)
+{
+    if (endOfStream)
+    {
+        return 0;
+    }
+    
+    if (audioEncoder == nullptr)
+    {
+        return -1;
+    }
+    
+    return audioEncoder->InsertSamples(samples, numSamples);
+}
+
+void Encoder::SetDebugPath(std::string path) {
+    debugPath = path;
+}
+
+void Encoder::SetDebugLog(LogCallback callback){
+    debugLog = callback;
+}
@@ -9,8 +9,26 @@
 #include <string>
 #include <math.h>
 #include <queue>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <limits.h>
 #include <inttypes.h>
 #include "FramePool.h"
+#include "RingQueue.h"
+#include "AudioStreamEncoder.h"
+#include "EncoderSession.h"
+#include "VideoOutput.h"
+#include "PicturePool.h"
+#include "RenditionEncoder.h"
+#include "ParallelGopEncoder.h"
+#include "TimestampEngine.h"
+#include "KeyframeScheduler.h"
+#include "Histogram.h"
+#include "EncoderStats.h"
+#include <vector>
 #include "SystemCallbacks.h"
 
 extern "C" {
@@ -29,13 +47,23 @@ extern "C" {
 
 enum CapturingCodec { H264 = 0, MPEG4 = 1, GIF = 2 };
 
-typedef struct EncodeStream {
-    AVFormatContext *formatContext;
-    AVStream *stream;
-    AVCodec *codec;
-    uint8_t *picture_buffer;
-    AVFrame *outputFrame;
-} EncodeStream;
+//Byte order of the 4 byte pixels handed to InsertFrame.
+enum CapturePixelOrder { PixelOrderRGBA = 0, PixelOrderBGRA = 1 };
+
+//Part of the capture that is encoded, in top-down pixels after the optional flip. Zero size means the whole frame.
+typedef struct CaptureRegion {
+    int x;
+    int y;
+    int width;
+    int height;
+} CaptureRegion;
+
+//Final numbers of a finished recording, reported when an asynchronous stop completes.
+typedef struct EncodeResult {
+    int64_t frames;
+    int64_t bytes;
+    int64_t durationUs;
+} EncodeResult;
 
 class Encoder{
     std::string debugPath;
@@ -47,28 +75,125 @@ class Encoder{
     int framerate;
     int bitrate;
     int iframeinterval;
-    int frameCount;
     bool flipV;
 	CapturingCodec captureCodec;
     
     EncodeStream* encodeStream;
-    AVFrame *encode_frame;
-    uint8_t *frame_data;
-    int64_t codecTime;
-    FramePool *framePool;
-    std::queue <FrameObject_t*> processingFrames;
-    uint8_t *flippedPixelBuffer;
-    
-    //State needed for gif generation.
-    struct SwsContext *frameScaleConverter;
-    AVFrame *rescaleFrame;
-	bool isRescaled;
-    
-    EncodeStream* OpenOutputFile(const char* file);
-	int ConfigureOutputVideo(EncodeStream *output, int contextWidth, int contextHeight);
-    int OpenOutputVideoCodec(EncodeStream *output);
-    int flush_encoder(AVFormatContext *fmt_ctx, int stream_index, int64_t pts);
+    RingQueue <FrameObject_t*> processingFrames;
+    
+    //Guards the queue and pool, frames are inserted on the render thread and encoded on another.
+    std::mutex frameLock;
+    
+    //Requested region, guarded by frameLock and picked up by the next inserted frame.
+    CaptureRegion captureRegion;
+    int encodedWidth;
+    int encodedHeight;
+    
+    //Set by the capturer, recorded with every inserted frame.
+    CapturePixelOrder pixelOrder;
+    
+    //Spacing of capture timestamps, shows clock jitter and hitches in the host render loop.
+    Histogram frameIntervals;
+    int64_t lastCaptureTimestamp;
+    
+    //Capture time to codec pts, only touched by the thread that inserts frames.
+    TimestampEngine timestamps;
+    TimestampMode timestampMode;
+    
+    //Time based, requested and scene-cut keyframes, iframeinterval is in seconds.
+    KeyframeScheduler keyframes;
+    int sceneCutThreshold;
+    
+    //Live mode trades compression for latency and hands out the NAL units of each frame once it is encoded.
+    bool liveMode;
+    int liveSlices;
+    NalUnitCallback nalCallback;
+    bool nalHeadersSent;
+    
+    //x264 preset and constant quality, empty and 0 keep ultrafast at the bitrate.
+    std::string codecPreset;
+    int constantQuality;
+    
+    //Capture time of frames inside the codec by pts, matched when their packet comes out.
+    RingQueue<std::pair<int64_t, int64_t>> captureTimes;
+    std::atomic<int64_t> lastLatency;
+    std::atomic<int64_t> maxLatency;
+    std::atomic<int64_t> totalLatency;
+    std::atomic<int64_t> latencyFrames;
+    
+    //Codec, pool and conversion buffers, kept warm between recordings with the same geometry.
+    EncoderSession *session;
+    
+    //Additional outputs at other resolutions fed from the same converted picture.
+    std::vector<RenditionEncoder*> renditions;
+    PicturePool *picturePool;
+    
+    //Last picture handed to the codec, encoded again for CFR slots the capture skipped.
+    AVFrame *lastPicture;
+    SharedPicture *lastSharedPicture;
+    
+    //Offline mode that encodes fixed length gops concurrently, disabled when gopChunkFrames is 0.
+    ParallelGopEncoder *parallelEncoder;
+    int gopChunkFrames;
+    int gopWorkers;
+    int gopMemoryLimitMB;
+    
+    //Set once the stream has ended, frames and audio arriving after that are dropped until the next StartEncoding.
+    std::atomic<bool> endOfStream;
+    std::thread stopThread;
+    
+    //Held while frames are encoded, so the stop thread only drains and closes the file once a running EncodeFrames returned.
+    std::mutex encodeLock;
+    
+    //Video packets muxed into the current file and the end of the last one.
+    std::atomic<int64_t> packetsWritten;
+    std::atomic<int64_t> writtenUntilUs;
+    
+    //Lock free counters and stage timings, cheap enough to poll every frame.
+    std::atomic<int64_t> insertedFrames;
+    std::atomic<int64_t> encodedFrames;
+    std::atomic<int64_t> droppedQueueFull;
+    std::atomic<int64_t> droppedDuplicate;
+    std::atomic<int64_t> droppedEndOfStream;
+    std::atomic<int64_t> queueHighWater;
+    std::atomic<int64_t> bytesWritten;
+    Histogram convertTimes;
+    Histogram scaleTimes;
+    Histogram encodeTimes;
+    Histogram writeTimes;
+    Histogram latencyTimes;
+    
+    //Chrome trace of the current recording, written when the stream is finished. Empty when tracing is off.
+    std::string traceFile;
+    bool tracing;
+    
+    //Frame markers read at insert and packets at write, for checking latency against the decoded file. Empty when off.
+    std::string markerLogFile;
+    std::atomic<bool> markerLogging;
+    std::mutex markerLock;
+    std::vector<std::pair<int64_t, int64_t>> markerInserts;
+    std::vector<std::pair<int64_t, int64_t>> markerWrites;
+    
+    //Live audio muxed into the same output file.
+    AudioStreamEncoder *audioEncoder;
+    int audioSampleRate;
+    int audioChannels;
+    
+    EncoderSession* CreateSession(AVCodec *codec, int inputWidth, int inputHeight, int outputWidth, int outputHeight, bool globalHeader, AVRational timeBase);
+    int OpenSessionCodec(EncoderSession *target);
+    void CloseOutputFile();
+    int flush_encoder(AVCodecContext *codecContext);
+    int EncodeQueuedFrames(int maxFrames);
+    int FinishEncoding(EncodeResult *result);
+    void WaitForStop();
     int EncodeFrame(AVFrame *frame);
+    void EncodePicture(AVFrame *frame, int64_t pts, bool keyframe, int64_t captureTime);
+    void TrackLatency(int64_t pts);
+    void LogInsertMarker(const uint8_t *frame, int stride);
+    int WriteMarkerLog();
+    void ResetStats();
+    CaptureRegion ResolveRegion();
+    int WritePacket(AVPacket *packet);
     
 public:
     Encoder(std::string videoFile, CapturingCodec codec, int encodeBitrate, int iframeinterval, bool flipVertical);
@@ -77,7 +202,29 @@ public:
     int EncodeFrames(int maxFrames);
 	int StartEncoding(int inputWidth, int inputHeight, int outputWidth, int outputHeight, int inputFramerate);
     int StopEncoding();
+    int StopEncodingAsync(std::function<void(int, const EncodeResult&)> completion);
     int InsertFrame(uint8_t *frame, int bytesPerPixel, int64_t timeStamp);
+    int InsertFrameUs(uint8_t *frame, int bytesPerPixel, int stride, int64_t timeStampUs);
+    void SetCaptureRegion(int x, int y, int regionWidth, int regionHeight);
+    void SetPixelOrder(CapturePixelOrder order);
+    int SetTimestampMode(TimestampMode mode);
+    void RequestKeyframe();
+    void SetSceneCutThreshold(int threshold);
+    int SetLiveMode(bool enabled, int slices, NalUnitCallback callback);
+    int SetQuality(std::string preset, int crf);
+    void GetLatency(int64_t *lastUs, int64_t *averageUs, int64_t *maxUs);
+    int GetFramerate();
+    void GetFrameIntervals(int64_t *meanUs, int64_t *p50Us, int64_t *p99Us, int64_t *maxUs);
+    void GetStats(EncoderStats *stats);
+    void SetOutputFile(std::string file);
+    void SetTraceFile(std::string file);
+    void SetMarkerLog(std::string file);
+    int AddRendition(std::string file, int outputWidth, int outputHeight, int encodeBitrate);
+    void ClearRenditions();
+    int SetParallelGopMode(int chunkFrames, int workerCount, int memoryLimitMB);
+    void ReleaseSession();
+    void SetAudioFormat(int sampleRate, int channels);
+    int InsertAudio(const float *samples, int numSamples);
     void SetDebugPath(std::string path);
     void SetDebugLog(LogCallback callback);
 };
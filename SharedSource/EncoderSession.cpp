@@ -0,0 +1,142 @@
+#include "EncoderSession.h"
+#include <stdlib.h>
+
+extern "C" {
+	#include "libavutil/imgutils.h"
+	#include "libavutil/mem.h"
+}
+
+EncoderSession::EncoderSession(AVCodec *codec, int inputWidth, int inputHeight, int outputWidth, int outputHeight, int framerate, int bitrate, bool globalHeader, AVRational timeBase)
+{
+    this->codec = codec;
+    this->inputWidth = inputWidth;
+    this->inputHeight = inputHeight;
+    this->outputWidth = outputWidth;
+    this->outputHeight = outputHeight;
+    this->framerate = framerate;
+    this->bitrate = bitrate;
+    this->globalHeader = globalHeader;
+    this->timeBase = timeBase;
+
+    codecContext = nullptr;
+    framePool = nullptr;
+    frame_data = nullptr;
+    encode_frame = nullptr;
+    packetBuffer = nullptr;
+    packetBufferSize = 0;
+    frameScaleConverter = nullptr;
+    rescaleFrame = nullptr;
+    isRescaled = false;
+    lastCodecPts = -1;
+    drained = false;
+    forceKeyframe = true;
+}
+
+EncoderSession::~EncoderSession()
+{
+    if (codecContext)
+    {
+        avcodec_free_context(&codecContext);
+    }
+
+    //Clear all memory for buffered images.
+    delete framePool;
+
+    //Free size conversion data.
+    sws_freeContext(frameScaleConverter);
+
+    if (rescaleFrame)
+    {
+        av_freep(&rescaleFrame->data[0]);
+        av_frame_free(&rescaleFrame);
+    }
+
+    av_free(frame_data);
+    av_frame_free(&encode_frame);
+    av_free(packetBuffer);
+}
+
+int EncoderSession::AllocateBuffers()
+{
+    int bufferSize = inputWidth * inputHeight * 4;
+    framePool = new FramePool(10, bufferSize);
+
+    int numBytes = avpicture_get_size(AV_PIX_FMT_YUV420P, inputWidth, inputHeight);
+    frame_data = (uint8_t *)av_malloc(numBytes * sizeof(uint8_t));
+    encode_frame = av_frame_alloc();
+    avpicture_fill((AVPicture *)encode_frame, frame_data, AV_PIX_FMT_YUV420P, inputWidth, inputHeight);
+    encode_frame->format = AV_PIX_FMT_YUV420P;
+    encode_frame->width = inputWidth;
+    encode_frame->height = inputHeight;
+
+    //Has to fit the largest packet any of our codecs may ask for, the mpeg4 encoder reserves about 3 KB per macroblock.
+    //Only the pages a packet actually writes get touched, the rest of the reservation costs no memory.
+    int macroblocks = ((outputWidth + 15) / 16) * ((outputHeight + 15) / 16);
+    packetBufferSize = macroblocks * 3100 + 10000 + AV_INPUT_BUFFER_MIN_SIZE;
+    packetBuffer = (uint8_t *)av_malloc(packetBufferSize + AV_INPUT_BUFFER_PADDING_SIZE);
+
+    if (packetBuffer == NULL)
+    {
+        return -1;
+    }
+
+    PrepareScaler(inputWidth, inputHeight);
+
+    return numBytes;
+}
+
+void EncoderSession::PrepareScaler(int sourceWidth, int sourceHeight)
+{
+    isRescaled = sourceWidth != outputWidth || sourceHeight != outputHeight || codecContext->pix_fmt != AV_PIX_FMT_YUV420P;
+
+    if (!isRescaled)
+    {
+        return;
+    }
+
+    if (rescaleFrame == nullptr)
+    {
+        rescaleFrame = av_frame_alloc();
+        rescaleFrame->format = codecContext->pix_fmt;
+        rescaleFrame->width = outputWidth;
+        rescaleFrame->height = outputHeight;
+        av_image_alloc(rescaleFrame->data, rescaleFrame->linesize, outputWidth, outputHeight, codecContext->pix_fmt, 1);
+    }
+
+    //Only rebuilt when the capture region changes size.
+    frameScaleConverter = sws_getCachedContext(frameScaleConverter, sourceWidth, sourceHeight, AV_PIX_FMT_YUV420P, outputWidth, outputHeight, codecContext->pix_fmt, SWS_BILINEAR, NULL, NULL, NULL);
+}
+
+void EncoderSession::SetPictureSize(AVFrame *frame, uint8_t *data, int width, int height)
+{
+    //The buffers are sized for the full capture, a smaller region is packed at the start.
+    if (frame->width == width && frame->height == height)
+    {
+        return;
+    }
+
+    avpicture_fill((AVPicture *)frame, data, AV_PIX_FMT_YUV420P, width, height);
+    frame->width = width;
+    frame->height = height;
+}
+
+bool EncoderSession::Matches(AVCodec *outputCodec, int inWidth, int inHeight, int outWidth, int outHeight, int inputFramerate, int encodeBitrate, bool needsGlobalHeader, AVRational codecTimeBase)
+{
+    return codecContext != nullptr &&
+        codec == outputCodec &&
+        inputWidth == inWidth &&
+        inputHeight == inHeight &&
+        outputWidth == outWidth &&
+        outputHeight == outHeight &&
+        framerate == inputFramerate &&
+        bitrate == encodeBitrate &&
+        globalHeader == needsGlobalHeader &&
+        av_cmp_q(timeBase, codecTimeBase) == 0;
+}
+
+void EncoderSession::BeginRecording()
+{
+    //Every recording gets a freshly opened codec, so its time starts over with the file.
+    lastCodecPts = -1;
+    forceKeyframe = true;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+#include "FramePool.h"
+
+extern "C" {
+	#include "libavcodec/avcodec.h"
+	#include "libswscale/swscale.h"
+	#include "libavutil/frame.h"
+}
+
+//Everything a recording needs that only depends on capture geometry and codec settings.
+//The encoder keeps it alive between recordings so back-to-back clips only open a new output file.
+class EncoderSession {
+public:
+    EncoderSession(AVCodec *codec, int inputWidth, int inputHeight, int outputWidth, int outputHeight, int framerate, int bitrate, bool globalHeader, AVRational timeBase);
+    ~EncoderSession();
+
+    AVCodec *codec;
+    AVCodecContext *codecContext;
+
+    int inputWidth;
+    int inputHeight;
+    int outputWidth;
+    int outputHeight;
+    int framerate;
+    int bitrate;
+    bool globalHeader;
+    AVRational timeBase;
+
+    //Pool to hold our incoming raw rgba frames.
+    FramePool *framePool;
+
+    //This is the main frame we convert and fill from the capturer output.
+    uint8_t *frame_data;
+    AVFrame *encode_frame;
+
+    //Output of the codec for every frame, handed to avcodec_encode_video2 as a user supplied packet.
+    uint8_t *packetBuffer;
+    int packetBufferSize;
+
+    //Size conversion state, only used when the capture region and output differ.
+    struct SwsContext *frameScaleConverter;
+    AVFrame *rescaleFrame;
+    bool isRescaled;
+
+    //Last pts handed to the codec in the current recording.
+    int64_t lastCodecPts;
+
+    //Set once the end of stream was sent. Encoders can not take frames after a flush, x264 stops its lookahead thread,
+    //so the next recording reopens the codec while the pool and conversion buffers stay warm.
+    bool drained;
+
+    //Set when a new recording starts, the first frame of every file has to be a keyframe.
+    bool forceKeyframe;
+
+    int AllocateBuffers();
+    void PrepareScaler(int sourceWidth, int sourceHeight);
+    static void SetPictureSize(AVFrame *frame, uint8_t *data, int width, int height);
+    bool Matches(AVCodec *outputCodec, int inWidth, int inHeight, int outWidth, int outHeight, int inputFramerate, int encodeBitrate, bool needsGlobalHeader, AVRational codecTimeBase);
+    void BeginRecording();
+};
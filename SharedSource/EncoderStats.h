@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+
+//Percentiles of the time one pipeline stage took per frame, in nanoseconds.
+typedef struct EncoderStageStats {
+    int64_t p50Ns;
+    int64_t p95Ns;
+    int64_t p99Ns;
+} EncoderStageStats;
+
+//Counters since the last StartEncoding. Plain fixed size fields so the struct can be passed across the plugin boundary as is.
+typedef struct EncoderStats {
+    int64_t framesInserted;
+    int64_t framesEncoded;
+
+    //Dropped because the queue was full, because the CFR slot already had a frame, or because the stream had ended.
+    int64_t droppedQueueFull;
+    int64_t droppedDuplicate;
+    int64_t droppedEndOfStream;
+
+    int64_t queueHighWater;
+    int64_t bytesWritten;
+
+    //Bits per second over the duration written so far.
+    int64_t bitrate;
+
+    EncoderStageStats convert;
+    EncoderStageStats scale;
+    EncoderStageStats encode;
+    EncoderStageStats write;
+
+    //From the end of the InsertFrame copy to the frame's packet leaving the codec.
+    EncoderStageStats latency;
+} EncoderStats;
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+//Frame index stamped into the top left corner of a capture, so a decoded recording can be matched to the frames that went in.
+//A row of FRAME_MARKER_BITS blocks, black for 0 and white for 1, holding 24 bits of index and an 8 bit check.
+//Each block covers a whole 16x16 macroblock, the pattern survives lossy encoding and 4:2:0 chroma.
+
+#define FRAME_MARKER_BLOCK 16
+#define FRAME_MARKER_BITS 32
+#define FRAME_MARKER_WIDTH (FRAME_MARKER_BLOCK * FRAME_MARKER_BITS)
+
+//Black frames would read as index 0 without the constant.
+static inline uint32_t frame_marker_word(uint32_t index)
+{
+    index &= 0xffffff;
+    uint32_t check = (index ^ (index >> 8) ^ (index >> 16) ^ 0xa5) & 0xff;
+
+    return index << 8 | check;
+}
+
+static inline int frame_marker_decode(uint32_t word, uint32_t *index)
+{
+    if (frame_marker_word(word >> 8) != word)
+    {
+        return -1;
+    }
+
+    *index = word >> 8;
+
+    return 0;
+}
+
+//Frames narrower than FRAME_MARKER_WIDTH or shorter than one block are left alone.
+static inline void frame_marker_stamp(uint8_t *rgba, int stride, int width, int height, uint32_t index)
+{
+    if (width < FRAME_MARKER_WIDTH || height < FRAME_MARKER_BLOCK)
+    {
+        return;
+    }
+
+    uint32_t word = frame_marker_word(index);
+
+    for (int y = 0; y < FRAME_MARKER_BLOCK; y++)
+    {
+        uint8_t *row = rgba + (ptrdiff_t)y * stride;
+
+        for (int bit = 0; bit < FRAME_MARKER_BITS; bit++)
+        {
+            uint8_t shade = (word >> (FRAME_MARKER_BITS - 1 - bit)) & 1 ? 255 : 0;
+            memset(row + bit * FRAME_MARKER_BLOCK * 4, shade, FRAME_MARKER_BLOCK * 4);
+        }
+    }
+}
+
+//Reads the green channel at the block centres, the same in RGBA and BGRA. A negative stride reads a bottom-up frame.
+static inline int frame_marker_read_rgba(const uint8_t *rgba, int stride, int width, int height, uint32_t *index)
+{
+    if (width < FRAME_MARKER_WIDTH || height < FRAME_MARKER_BLOCK)
+    {
+        return -1;
+    }
+
+    const uint8_t *row = rgba + (ptrdiff_t)(FRAME_MARKER_BLOCK / 2) * stride;
+    uint32_t word = 0;
+
+    for (int bit = 0; bit < FRAME_MARKER_BITS; bit++)
+    {
+        int x = bit * FRAME_MARKER_BLOCK + FRAME_MARKER_BLOCK / 2;
+        word = word << 1 | (row[x * 4 + 1] >= 128 ? 1 : 0);
+    }
+
+    return frame_marker_decode(word, index);
+}
+
+//Reads a decoded luma plane, averaging the middle of each block against encoding noise.
+//scale is the output width over the capture width when the encoder resized the frames.
+static inline int frame_marker_read_luma(const uint8_t *luma, int linesize, int width, int height, double scale, uint32_t *index)
+{
+    double block = FRAME_MARKER_BLOCK * scale;
+
+    if (block < 4 || width < block * FRAME_MARKER_BITS || height < block)
+    {
+        return -1;
+    }
+
+    uint32_t word = 0;
+    int centreY = (int)(block / 2);
+
+    for (int bit = 0; bit < FRAME_MARKER_BITS; bit++)
+    {
+        int centreX = (int)(bit * block + block / 2);
+        int sum = 0;
+
+        for (int y = centreY - 1; y <= centreY + 1; y++)
+        {
+            for (int x = centreX - 1; x <= centreX + 1; x++)
+            {
+                sum += luma[(ptrdiff_t)y * linesize + x];
+            }
+        }
+
+        word = word << 1 | (sum / 9 >= 128 ? 1 : 0);
+    }
+
+    return frame_marker_decode(word, index);
+}
@@ -0,0 +1,52 @@
+#include "FramePacer.h"
+
+FramePacer::FramePacer()
+{
+    Start(0);
+}
+
+void FramePacer::Start(int targetFramerate)
+{
+    intervalNs = targetFramerate > 0 ? 1000000000 / targetFramerate : 0;
+    nextDueNs = 0;
+    capturedFrames = 0;
+    skippedFrames = 0;
+}
+
+bool FramePacer::IsFrameDue(int64_t nowNs)
+{
+    if (intervalNs == 0)
+    {
+        capturedFrames++;
+        return true;
+    }
+
+    //Accept a frame slightly early, otherwise vsync jitter at an exact multiple of the target
+    //(60 fps render for 30 fps capture) would skip the intended frame and take the one after.
+    if (nextDueNs != 0 && nowNs < nextDueNs - intervalNs / 4)
+    {
+        skippedFrames++;
+        return false;
+    }
+
+    //Stay on the grid, but start over after a stall instead of capturing a burst to catch up.
+    if (nextDueNs == 0 || nowNs - nextDueNs > intervalNs)
+    {
+        nextDueNs = nowNs;
+    }
+
+    nextDueNs += intervalNs;
+    capturedFrames++;
+
+    return true;
+}
+
+int64_t FramePacer::CapturedFrames()
+{
+    return capturedFrames;
+}
+
+int64_t FramePacer::SkippedFrames()
+{
+    return skippedFrames;
+}
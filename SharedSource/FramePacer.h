@@ -0,0 +1,26 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+//Decides per render event whether a capture is due for the target frame rate, so backends can
+//skip the readback and conversion of frames the encoder would not use anyway.
+class FramePacer {
+    int64_t intervalNs;
+    int64_t nextDueNs;
+
+    std::atomic<int64_t> capturedFrames;
+    std::atomic<int64_t> skippedFrames;
+
+public:
+    FramePacer();
+
+    //A target of 0 captures every render event.
+    void Start(int targetFramerate);
+
+    //Called on the render thread with the monotonic clock.
+    bool IsFrameDue(int64_t nowNs);
+
+    int64_t CapturedFrames();
+    int64_t SkippedFrames();
+};
@@ -8,6 +8,7 @@
 FramePool::FramePool(int size, int frameSize) 
 {
     numberOfFrames = size;
+    freeFrames.Reserve(size);
 
     //Pre-allocate frames for pool
     for (int i = 0; i < numberOfFrames; i++){
@@ -15,6 +16,11 @@ FramePool::FramePool(int size, int frameSize)
         FrameObject_t *frame = (FrameObject_t*)malloc((sizeof(FrameObject_t)));
         frame->frame = (uint8_t*)(malloc(frameSize));
         frame->pts = 0;
+        frame->gap = 0;
+        frame->captureTime = 0;
+        frame->width = 0;
+        frame->height = 0;
+        frame->pixelOrder = 0;
 
         freeFrames.push(frame);
     }
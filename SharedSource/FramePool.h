@@ -4,8 +4,8 @@
 
 #pragma once
 
-#include <queue>
 #include <stdint.h>
+#include "RingQueue.h"
 
 #if defined(__APPLE__) || defined(__linux__) || defined(__unix__)
 #include <pthread.h>
@@ -27,11 +27,18 @@ typedef struct FrameObject
 {
     uint8_t *frame;
     int64_t pts;
+
+    //Empty CFR slots before this frame, encoded as copies of the previous picture.
+    int gap;
+    int64_t captureTime;
+    int width;
+    int height;
+    int pixelOrder;
 } FrameObject_t;
 
 class FramePool {
     int numberOfFrames;
-    std::queue <FrameObject_t*> freeFrames;
+    RingQueue <FrameObject_t*> freeFrames;
 
 	#if defined(__APPLE__) || defined(__linux__) || defined(__unix__)
     struct EncodeThreadSyncObject syncObject;
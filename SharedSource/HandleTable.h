@@ -0,0 +1,60 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+
+//Maps opaque integer handles handed out through the C interface to live objects.
+//Lookups return a shared reference, so an object destroyed on one thread stays valid
+//for a call already running on another thread until that call returns.
+template <typename T>
+class HandleTable {
+    std::mutex tableLock;
+    std::map<int, std::shared_ptr<T>> objects;
+    int nextHandle = 1;
+
+public:
+    int Add(T *object)
+    {
+        std::lock_guard<std::mutex> lock(tableLock);
+
+        int handle = nextHandle++;
+        objects[handle] = std::shared_ptr<T>(object);
+
+        return handle;
+    }
+
+    std::shared_ptr<T> Get(int handle)
+    {
+        std::lock_guard<std::mutex> lock(tableLock);
+
+        auto it = objects.find(handle);
+        if (it == objects.end())
+        {
+            return nullptr;
+        }
+
+        return it->second;
+    }
+
+    bool Remove(int handle)
+    {
+        std::shared_ptr<T> removed;
+
+        {
+            std::lock_guard<std::mutex> lock(tableLock);
+
+            auto it = objects.find(handle);
+            if (it == objects.end())
+            {
+                return false;
+            }
+
+            removed = it->second;
+            objects.erase(it);
+        }
+
+        //The object is deleted outside the lock once the last caller lets go of it.
+        return true;
+    }
+};
@@ -0,0 +1,101 @@
+#include "Histogram.h"
+
+Histogram::Histogram()
+{
+    Reset();
+}
+
+void Histogram::Reset()
+{
+    for (int i = 0; i < bucketCount; i++)
+    {
+        buckets[i] = 0;
+    }
+
+    count = 0;
+    sum = 0;
+    maxValue = 0;
+}
+
+int Histogram::BucketIndex(int64_t value)
+{
+    if (value < 4)
+    {
+        return value < 0 ? 0 : (int)value;
+    }
+
+    int msb = 0;
+    while ((value >> (msb + 1)) != 0)
+    {
+        msb++;
+    }
+
+    //Four sub buckets per power of two, taken from the two bits below the highest one.
+    int index = (msb - 1) * 4 + (int)((value >> (msb - 2)) & 3);
+
+    return index < bucketCount ? index : bucketCount - 1;
+}
+
+int64_t Histogram::BucketValue(int index)
+{
+    if (index < 4)
+    {
+        return index;
+    }
+
+    int msb = index / 4 + 1;
+    int64_t sub = index % 4;
+
+    return ((int64_t)4 + sub) << (msb - 2);
+}
+
+void Histogram::Record(int64_t value)
+{
+    buckets[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(value, std::memory_order_relaxed);
+
+    int64_t previous = maxValue.load(std::memory_order_relaxed);
+    while (value > previous && !maxValue.compare_exchange_weak(previous, value, std::memory_order_relaxed));
+}
+
+int64_t Histogram::Count()
+{
+    return count.load(std::memory_order_relaxed);
+}
+
+int64_t Histogram::Mean()
+{
+    int64_t samples = Count();
+    return samples > 0 ? sum.load(std::memory_order_relaxed) / samples : 0;
+}
+
+int64_t Histogram::Max()
+{
+    return maxValue.load(std::memory_order_relaxed);
+}
+
+int64_t Histogram::Percentile(double percentile)
+{
+    int64_t samples = Count();
+
+    if (samples == 0)
+    {
+        return 0;
+    }
+
+    int64_t target = (int64_t)((double)samples * percentile / 100.0);
+    int64_t seen = 0;
+
+    for (int i = 0; i < bucketCount; i++)
+    {
+        seen += buckets[i].load(std::memory_order_relaxed);
+
+        if (seen > target)
+        {
+            return BucketValue(i);
+        }
+    }
+
+    return Max();
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+//Lock free histogram of non-negative values, e.g. microseconds. Buckets are a power of two
+//split in four, so percentiles are accurate to within 25% at any scale.
+class Histogram {
+    static const int bucketCount = 160;
+
+    std::atomic<int64_t> buckets[bucketCount];
+    std::atomic<int64_t> count;
+    std::atomic<int64_t> sum;
+    std::atomic<int64_t> maxValue;
+
+    static int BucketIndex(int64_t value);
+    static int64_t BucketValue(int index);
+
+public:
+    Histogram();
+
+    void Reset();
+
+    //Safe to call from any thread.
+    void Record(int64_t value);
+
+    int64_t Count();
+    int64_t Mean();
+    int64_t Max();
+
+    //Lower bound of the bucket holding the given percentile, 0 to 100.
+    int64_t Percentile(double percentile);
+};
@@ -0,0 +1,95 @@
+#include "KeyframeScheduler.h"
+#include <stdlib.h>
+
+static const int lumaStep = 8;
+
+KeyframeScheduler::KeyframeScheduler()
+{
+    intervalUs = 0;
+    sceneCutThreshold = 0;
+    requested = false;
+    lastKeyframeUs = 0;
+}
+
+void KeyframeScheduler::Configure(int intervalSeconds, int threshold)
+{
+    intervalUs = intervalSeconds > 0 ? (int64_t)intervalSeconds * 1000000 : 0;
+    sceneCutThreshold = threshold > 0 ? threshold : 0;
+}
+
+void KeyframeScheduler::Reset()
+{
+    requested = false;
+    lastKeyframeUs = 0;
+    previousLuma.clear();
+}
+
+void KeyframeScheduler::Request()
+{
+    requested = true;
+}
+
+bool KeyframeScheduler::ShouldForceKeyframe(const uint8_t *luma, int stride, int width, int height, int64_t timeUs, bool forced)
+{
+    bool keyframe = forced;
+
+    if (requested.exchange(false))
+    {
+        keyframe = true;
+    }
+
+    if (intervalUs > 0 && timeUs - lastKeyframeUs >= intervalUs)
+    {
+        keyframe = true;
+    }
+
+    //Always sample so the comparison is against the frame right before this one.
+    if (sceneCutThreshold > 0 && IsSceneCut(luma, stride, width, height))
+    {
+        keyframe = true;
+    }
+
+    if (keyframe)
+    {
+        lastKeyframeUs = timeUs;
+    }
+
+    return keyframe;
+}
+
+bool KeyframeScheduler::IsSceneCut(const uint8_t *luma, int stride, int width, int height)
+{
+    int columns = width / lumaStep;
+    int rows = height / lumaStep;
+    size_t samples = (size_t)columns * rows;
+
+    if (samples == 0)
+    {
+        return false;
+    }
+
+    bool hasPrevious = previousLuma.size() == samples;
+
+    if (!hasPrevious)
+    {
+        previousLuma.resize(samples);
+    }
+
+    int64_t difference = 0;
+    uint8_t *previous = previousLuma.data();
+
+    for (int y = 0; y < rows; y++)
+    {
+        const uint8_t *row = luma + (size_t)y * lumaStep * stride;
+
+        for (int x = 0; x < columns; x++)
+        {
+            uint8_t sample = row[x * lumaStep];
+            difference += abs((int)sample - (int)*previous);
+            *previous++ = sample;
+        }
+    }
+
+    //Mean absolute difference per sample, in luma levels.
+    return hasPrevious && difference / (int64_t)samples >= sceneCutThreshold;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <vector>
+
+//Decides which frames are sent to the codec as forced keyframes: on a fixed time interval,
+//on request from the host (chapter points) and optionally on scene cuts.
+class KeyframeScheduler {
+    int64_t intervalUs;
+    int sceneCutThreshold;
+
+    std::atomic<bool> requested;
+    int64_t lastKeyframeUs;
+
+    //Every 8th luma sample of the previous frame, enough to spot a cut without touching the whole plane.
+    std::vector<uint8_t> previousLuma;
+
+    bool IsSceneCut(const uint8_t *luma, int stride, int width, int height);
+
+public:
+    KeyframeScheduler();
+
+    //An interval of 0 leaves keyframes to the codec, a threshold of 0 turns scene-cut detection off.
+    void Configure(int intervalSeconds, int threshold);
+    void Reset();
+
+    //Safe to call from any thread, the next encoded frame becomes a keyframe.
+    void Request();
+
+    //Called once per frame on the encode thread with the I420 luma plane.
+    bool ShouldForceKeyframe(const uint8_t *luma, int stride, int width, int height, int64_t timeUs, bool forced);
+};
@@ -0,0 +1,322 @@
+#include "Logger.h"
+#include <stdio.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <chrono>
+
+//Bounded ring with a sequence number per cell, any thread may push or drain without a lock.
+#define LOG_RING_SIZE 1024
+
+struct LogCell
+{
+    std::atomic<size_t> sequence;
+    LogRecord record;
+};
+
+static LogCell ring[LOG_RING_SIZE];
+static std::atomic<size_t> enqueuePosition(0);
+static std::atomic<size_t> dequeuePosition(0);
+static std::atomic<bool> ringReady(false);
+
+static std::atomic<int> minimumLevel(LOG_LEVEL_DEBUG);
+static std::atomic<int> rateLimit(10);
+static std::atomic<int64_t> droppedRecords(0);
+
+static std::atomic<int> formatterState(0);
+static std::atomic<bool> formatterRunning(false);
+
+//The formatter sleeps until a push finds it asleep and wakes it, pushes to a busy formatter never touch the lock.
+static std::mutex formatterLock;
+static std::condition_variable formatterWake;
+static std::atomic<bool> formatterSleeping(false);
+
+static const int formatterIdle = 0;
+static const int formatterStarting = 1;
+static const int formatterStarted = 2;
+
+static void prepare_ring()
+{
+    static std::atomic<int> preparing(0);
+
+    if (ringReady.load(std::memory_order_acquire))
+    {
+        return;
+    }
+
+    int expected = 0;
+    if (preparing.compare_exchange_strong(expected, 1))
+    {
+        for (size_t i = 0; i < LOG_RING_SIZE; i++)
+        {
+            ring[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        ringReady.store(true, std::memory_order_release);
+    }
+    else
+    {
+        while (!ringReady.load(std::memory_order_acquire))
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+static bool ring_pop(LogRecord *record)
+{
+    size_t position = dequeuePosition.load(std::memory_order_relaxed);
+
+    while (true)
+    {
+        LogCell *cell = &ring[position % LOG_RING_SIZE];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)(position + 1);
+
+        if (difference == 0)
+        {
+            if (dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+            {
+                *record = cell->record;
+                cell->sequence.store(position + LOG_RING_SIZE, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (difference < 0)
+        {
+            return false;
+        }
+        else
+        {
+            position = dequeuePosition.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+static bool ring_has_records()
+{
+    size_t position = dequeuePosition.load(std::memory_order_relaxed);
+
+    return ring[position % LOG_RING_SIZE].sequence.load(std::memory_order_acquire) == position + 1;
+}
+
+static void wake_formatter()
+{
+    //Taking the lock orders the notify after the formatter has either seen the record or started waiting.
+    {
+        std::lock_guard<std::mutex> lock(formatterLock);
+    }
+
+    formatterWake.notify_one();
+}
+
+//Replaces each {} with the next argument.
+static void format_record(const LogRecord *record, char *buffer, size_t size)
+{
+    size_t used = 0;
+    int argument = 0;
+    const char *format = record->format;
+
+    while (*format != '\0' && used + 1 < size)
+    {
+        if (format[0] == '{' && format[1] == '}' && argument < record->argCount)
+        {
+            const LogArg *arg = &record->args[argument++];
+            int written = 0;
+
+            switch (arg->type)
+            {
+                case LogArgInt:
+                    written = snprintf(buffer + used, size - used, "%lld", (long long)arg->i);
+                    break;
+                case LogArgUInt:
+                    written = snprintf(buffer + used, size - used, "%llu", (unsigned long long)arg->u);
+                    break;
+                case LogArgDouble:
+                    written = snprintf(buffer + used, size - used, "%.3f", arg->d);
+                    break;
+                case LogArgString:
+                    written = snprintf(buffer + used, size - used, "%s", record->text + arg->offset);
+                    break;
+                default:
+                    written = snprintf(buffer + used, size - used, "%p", arg->p);
+                    break;
+            }
+
+            used += written > 0 ? (size_t)written : 0;
+            used = used < size ? used : size - 1;
+            format += 2;
+        }
+        else
+        {
+            buffer[used++] = *format++;
+        }
+    }
+
+    if (record->suppressed > 0 && used + 1 < size)
+    {
+        snprintf(buffer + used, size - used, " (%d similar suppressed)", record->suppressed);
+    }
+    else
+    {
+        buffer[used] = '\0';
+    }
+}
+
+static void drain_ring()
+{
+    LogRecord record;
+    char buffer[512];
+
+    while (ring_pop(&record))
+    {
+        format_record(&record, buffer, sizeof(buffer));
+        record.callback(buffer);
+    }
+}
+
+static void formatter_loop()
+{
+    while (formatterRunning)
+    {
+        drain_ring();
+
+        //Flag then ring here, ring then flag in Push, so a record published while falling asleep is seen by one of the two.
+        std::unique_lock<std::mutex> lock(formatterLock);
+        formatterSleeping = true;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        formatterWake.wait(lock, []() { return !formatterRunning || ring_has_records(); });
+        formatterSleeping = false;
+    }
+
+    drain_ring();
+    formatterState = formatterIdle;
+}
+
+static void start_formatter()
+{
+    int expected = formatterIdle;
+
+    if (formatterState.load(std::memory_order_acquire) == formatterStarted || !formatterState.compare_exchange_strong(expected, formatterStarting))
+    {
+        return;
+    }
+
+    //Detached so nothing has to join it from a static destructor, Shutdown waits for it instead.
+    formatterRunning = true;
+    std::thread(formatter_loop).detach();
+    formatterState = formatterStarted;
+}
+
+void Logger::SetLevel(int level)
+{
+    minimumLevel = level;
+}
+
+void Logger::SetRateLimit(int messagesPerSecond)
+{
+    rateLimit = messagesPerSecond;
+}
+
+bool Logger::Allow(LogSite *site, int level, int64_t nowNs)
+{
+    if (level < minimumLevel)
+    {
+        return false;
+    }
+
+    int limit = rateLimit;
+
+    if (limit <= 0)
+    {
+        return true;
+    }
+
+    //One second windows per call site, racing threads may let a message or two extra through.
+    int64_t windowStart = site->windowStart.load(std::memory_order_relaxed);
+
+    if (nowNs - windowStart >= 1000000000)
+    {
+        site->windowStart.store(nowNs, std::memory_order_relaxed);
+        site->windowCount.store(0, std::memory_order_relaxed);
+    }
+
+    if (site->windowCount.fetch_add(1, std::memory_order_relaxed) >= limit)
+    {
+        site->suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    return true;
+}
+
+void Logger::Push(const LogRecord *record)
+{
+    prepare_ring();
+    start_formatter();
+
+    size_t position = enqueuePosition.load(std::memory_order_relaxed);
+
+    while (true)
+    {
+        LogCell *cell = &ring[position % LOG_RING_SIZE];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+
+        if (difference == 0)
+        {
+            if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+            {
+                cell->record = *record;
+                cell->sequence.store(position + 1, std::memory_order_release);
+
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (formatterSleeping.load(std::memory_order_relaxed))
+                {
+                    wake_formatter();
+                }
+                return;
+            }
+        }
+        else if (difference < 0)
+        {
+            //Full, the formatter is behind. Never wait on the hot path.
+            droppedRecords++;
+            return;
+        }
+        else
+        {
+            position = enqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void Logger::Flush()
+{
+    if (ringReady)
+    {
+        drain_ring();
+    }
+}
+
+void Logger::Shutdown()
+{
+    if (formatterState != formatterStarted)
+    {
+        return;
+    }
+
+    formatterRunning = false;
+    wake_formatter();
+
+    //The loop drains once more before it marks itself idle.
+    while (formatterState != formatterIdle)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+int64_t Logger::DroppedRecords()
+{
+    return droppedRecords;
+}
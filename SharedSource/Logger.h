@@ -0,0 +1,222 @@
+#pragma once
+
+#include <atomic>
+#include <type_traits>
+#include <stdint.h>
+#include <string.h>
+#include "SystemCallbacks.h"
+#include "TimeTools.h"
+
+//Leveled logging for code that runs per frame. A call packs its arguments into a fixed size record
+//and pushes it into a lock free ring, a background thread formats it and calls the LogCallback.
+//The hot path never builds a string or calls into managed code.
+//
+//  LOG_WARN(debugLog, "Dropped frame {} after {} us", frameIndex, elapsedUs);
+//
+//Each {} takes the next argument. Integers, floating point values, enums, pointers and strings are
+//supported, strings are copied so stack buffers are fine.
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_OFF 4
+
+//Calls below this level are removed by the preprocessor, arguments and all.
+#ifndef LOG_COMPILED_LEVEL
+#define LOG_COMPILED_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_MAX_ARGS 4
+#define LOG_TEXT_SIZE 96
+
+enum LogArgType { LogArgInt = 0, LogArgUInt = 1, LogArgDouble = 2, LogArgString = 3, LogArgPointer = 4 };
+
+struct LogArg
+{
+    int type;
+    union
+    {
+        int64_t i;
+        uint64_t u;
+        double d;
+        const void *p;
+        int offset;
+    };
+};
+
+struct LogRecord
+{
+    int64_t timeNs;
+    LogCallback callback;
+    const char *format;
+    int level;
+    int argCount;
+    int suppressed;
+    int textUsed;
+    LogArg args[LOG_MAX_ARGS];
+    char text[LOG_TEXT_SIZE];
+};
+
+//Rate limiting state of one call site, zero initialized as a function local static.
+struct LogSite
+{
+    std::atomic<int64_t> windowStart;
+    std::atomic<int> windowCount;
+    std::atomic<int> suppressed;
+};
+
+class Logger
+{
+public:
+    //Runtime filter on top of the compiled level.
+    static void SetLevel(int level);
+
+    //Messages per second and call site, the rest are counted and reported with the next one through.
+    static void SetRateLimit(int messagesPerSecond);
+
+    static bool Allow(LogSite *site, int level, int64_t nowNs);
+
+    //Copies the record into the ring. When it is full the record is dropped and counted.
+    static void Push(const LogRecord *record);
+
+    //Formats everything queued so far on the calling thread.
+    static void Flush();
+
+    //Stops the formatter thread after draining the ring, call before the library is unloaded.
+    static void Shutdown();
+
+    static int64_t DroppedRecords();
+};
+
+template <typename T>
+static inline typename std::enable_if<(std::is_integral<T>::value || std::is_enum<T>::value) && std::is_signed<typename std::conditional<std::is_enum<T>::value, int, T>::type>::value>::type
+log_pack(LogRecord *, LogArg *arg, T value)
+{
+    arg->type = LogArgInt;
+    arg->i = (int64_t)value;
+}
+
+template <typename T>
+static inline typename std::enable_if<(std::is_integral<T>::value || std::is_enum<T>::value) && !std::is_signed<typename std::conditional<std::is_enum<T>::value, int, T>::type>::value>::type
+log_pack(LogRecord *, LogArg *arg, T value)
+{
+    arg->type = LogArgUInt;
+    arg->u = (uint64_t)value;
+}
+
+template <typename T>
+static inline typename std::enable_if<std::is_floating_point<T>::value>::type
+log_pack(LogRecord *, LogArg *arg, T value)
+{
+    arg->type = LogArgDouble;
+    arg->d = (double)value;
+}
+
+template <typename T>
+static inline typename std::enable_if<std::is_pointer<T>::value>::type
+log_pack(LogRecord *, LogArg *arg, T value)
+{
+    arg->type = LogArgPointer;
+    arg->p = (const void*)value;
+}
+
+//Strings are copied into the record, truncated when the text space runs out.
+static inline void log_pack(LogRecord *record, LogArg *arg, const char *value)
+{
+    int space = LOG_TEXT_SIZE - record->textUsed - 1;
+    arg->type = LogArgString;
+
+    //Once the text is full the remaining strings share its final byte as an empty string.
+    if (space <= 0)
+    {
+        arg->offset = LOG_TEXT_SIZE - 1;
+        record->text[LOG_TEXT_SIZE - 1] = '\0';
+        record->textUsed = LOG_TEXT_SIZE;
+        return;
+    }
+
+    int length = value != NULL ? (int)strlen(value) : 0;
+    length = length < space ? length : space;
+    arg->offset = record->textUsed;
+
+    if (length > 0)
+    {
+        memcpy(record->text + record->textUsed, value, length);
+    }
+
+    record->text[record->textUsed + length] = '\0';
+    record->textUsed += length + 1;
+}
+
+static inline void log_pack(LogRecord *record, LogArg *arg, char *value)
+{
+    log_pack(record, arg, (const char*)value);
+}
+
+static inline void log_pack_all(LogRecord *)
+{
+}
+
+template <typename T, typename... Rest>
+static inline void log_pack_all(LogRecord *record, T value, Rest... rest)
+{
+    static_assert(sizeof...(Rest) < LOG_MAX_ARGS, "Too many log arguments");
+
+    log_pack(record, &record->args[record->argCount++], value);
+    log_pack_all(record, rest...);
+}
+
+template <typename... Args>
+static inline void log_write(LogSite *site, int level, LogCallback callback, const char *format, Args... args)
+{
+    int64_t now = timenow_ns();
+
+    if (!Logger::Allow(site, level, now))
+    {
+        return;
+    }
+
+    LogRecord record;
+    record.timeNs = now;
+    record.callback = callback;
+    record.format = format;
+    record.level = level;
+    record.argCount = 0;
+    record.textUsed = 0;
+    record.suppressed = site->suppressed.exchange(0);
+
+    log_pack_all(&record, args...);
+    Logger::Push(&record);
+}
+
+#define LOG_AT(level, callback, ...) do { \
+    if ((callback) != NULL) { \
+        static LogSite logSite; \
+        log_write(&logSite, level, callback, __VA_ARGS__); \
+    } \
+} while (0)
+
+#if LOG_COMPILED_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(callback, ...) LOG_AT(LOG_LEVEL_DEBUG, callback, __VA_ARGS__)
+#else
+#define LOG_DEBUG(callback, ...) do { } while (0)
+#endif
+
+#if LOG_COMPILED_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(callback, ...) LOG_AT(LOG_LEVEL_INFO, callback, __VA_ARGS__)
+#else
+#define LOG_INFO(callback, ...) do { } while (0)
+#endif
+
+#if LOG_COMPILED_LEVEL <= LOG_LEVEL_WARN
+#define LOG_WARN(callback, ...) LOG_AT(LOG_LEVEL_WARN, callback, __VA_ARGS__)
+#else
+#define LOG_WARN(callback, ...) do { } while (0)
+#endif
+
+#if LOG_COMPILED_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR(callback, ...) LOG_AT(LOG_LEVEL_ERROR, callback, __VA_ARGS__)
+#else
+#define LOG_ERROR(callback, ...) do { } while (0)
+#endif
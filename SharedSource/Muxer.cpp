@@ -5,6 +5,7 @@
 
 #include "Muxer.h"
 #include "AACEncoder.h"
+#include "Tracer.h"
 
 Muxer::Muxer(std::string inputVideoFile, std::string inputAudioFile) {
     this->videoFile = inputVideoFile;
@@ -57,6 +58,7 @@ int Muxer::startMuxing(std::string outputFile) {
     int64_t cur_pts = 0;
 
     while(av_read_frame(videoSource->formatContext, &videoPacket) >= 0){
+        TRACE_SCOPE("MuxPacket", videoPacket.pts);
         AVStream* outputStream = output->videoStream;
         AVStream* inputStream = videoSource->inputStream;
         int outStreamIndex = outputStream->index;
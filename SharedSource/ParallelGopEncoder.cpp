@@ -0,0 +1,365 @@
+#include "ParallelGopEncoder.h"
+#include "Logger.h"
+#include "Tracer.h"
+
+#include <string.h>
+
+extern "C" {
+	#include "libavutil/imgutils.h"
+}
+
+ParallelGopEncoder::ParallelGopEncoder(AVCodec *outputCodec, const VideoCodecSettings *codecSettings, AVPixelFormat format,
+                                       int framesPerChunk, int workers, int memoryLimitMB, LogCallback callback)
+{
+    codec = outputCodec;
+    settings = *codecSettings;
+    pixelFormat = format;
+    chunkFrames = framesPerChunk > 0 ? framesPerChunk : 1;
+    workerCount = workers > 0 ? workers : 1;
+    debugLog = callback;
+
+    fillingChunk = nullptr;
+    nextSequence = 0;
+    stopRequested = false;
+
+    //Every worker needs a chunk to encode plus one being filled, otherwise honour the memory limit.
+    int64_t chunkBytes = (int64_t)av_image_get_buffer_size(pixelFormat, settings.width, settings.height, 1) * chunkFrames;
+    int64_t limitChunks = chunkBytes > 0 ? ((int64_t)memoryLimitMB * 1024 * 1024) / chunkBytes : 0;
+    maxChunks = (int)(limitChunks > workerCount + 1 ? limitChunks : workerCount + 1);
+
+    for (int i = 0; i < maxChunks; i++)
+    {
+        GopChunk *chunk = new GopChunk();
+        chunk->sequence = 0;
+        chunk->frameCount = 0;
+        chunk->encoded = false;
+
+        for (int j = 0; j < chunkFrames; j++)
+        {
+            AVFrame *frame = av_frame_alloc();
+            frame->format = pixelFormat;
+            frame->width = settings.width;
+            frame->height = settings.height;
+            av_frame_get_buffer(frame, 32);
+            chunk->frames.push_back(frame);
+        }
+
+        chunks.push_back(chunk);
+        freeChunks.push_back(chunk);
+    }
+}
+
+ParallelGopEncoder::~ParallelGopEncoder()
+{
+    StopWorkers();
+
+    for (size_t i = 0; i < chunks.size(); i++)
+    {
+        GopChunk *chunk = chunks[i];
+
+        for (size_t j = 0; j < chunk->frames.size(); j++)
+        {
+            av_frame_free(&chunk->frames[j]);
+        }
+
+        for (size_t j = 0; j < chunk->packets.size(); j++)
+        {
+            av_packet_unref(&chunk->packets[j]);
+        }
+
+        delete chunk;
+    }
+}
+
+int ParallelGopEncoder::CopyExtradata(AVCodecContext *streamContext)
+{
+    //x264 derives sps fields such as the frame number range from keyint, so the headers only match a worker context.
+    AVCodecContext *context = OpenWorkerCodec();
+
+    if (context == nullptr)
+    {
+        return -1;
+    }
+
+    av_freep(&streamContext->extradata);
+    streamContext->extradata_size = 0;
+
+    if (context->extradata_size > 0)
+    {
+        streamContext->extradata = (uint8_t *)av_mallocz(context->extradata_size + AV_INPUT_BUFFER_PADDING_SIZE);
+
+        if (streamContext->extradata == NULL)
+        {
+            avcodec_free_context(&context);
+            return -1;
+        }
+
+        memcpy(streamContext->extradata, context->extradata, context->extradata_size);
+        streamContext->extradata_size = context->extradata_size;
+    }
+
+    streamContext->gop_size = context->gop_size;
+    streamContext->has_b_frames = context->has_b_frames;
+    avcodec_free_context(&context);
+
+    return 0;
+}
+
+int ParallelGopEncoder::Start(std::function<int(AVPacket*)> packetWriter)
+{
+    writePacket = packetWriter;
+    stopRequested = false;
+
+    for (int i = 0; i < workerCount; i++)
+    {
+        workers.push_back(std::thread(&ParallelGopEncoder::WorkerLoop, this));
+    }
+
+    return 0;
+}
+
+int ParallelGopEncoder::Submit(AVFrame *frame)
+{
+    if (fillingChunk == nullptr)
+    {
+        std::unique_lock<std::mutex> lock(chunkLock);
+
+        //All chunks are in use, write out finished ones until one comes back.
+        while (freeChunks.empty())
+        {
+            if (!inFlight.empty() && inFlight.front()->encoded)
+            {
+                lock.unlock();
+                WriteFinishedChunks(false);
+                lock.lock();
+                continue;
+            }
+
+            chunkEncoded.wait(lock);
+        }
+
+        fillingChunk = freeChunks.front();
+        freeChunks.pop_front();
+        fillingChunk->sequence = nextSequence++;
+        fillingChunk->frameCount = 0;
+        fillingChunk->encoded = false;
+    }
+
+    AVFrame *copy = fillingChunk->frames[fillingChunk->frameCount++];
+    av_frame_copy(copy, frame);
+    copy->pts = frame->pts;
+    copy->pict_type = frame->pict_type;
+
+    if (fillingChunk->frameCount == chunkFrames)
+    {
+        QueueFillingChunk();
+    }
+
+    return WriteFinishedChunks(false);
+}
+
+int ParallelGopEncoder::Flush()
+{
+    QueueFillingChunk();
+
+    int ret = WriteFinishedChunks(true);
+
+    StopWorkers();
+
+    return ret;
+}
+
+void ParallelGopEncoder::QueueFillingChunk()
+{
+    if (fillingChunk == nullptr || fillingChunk->frameCount == 0)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(chunkLock);
+        encodeQueue.push_back(fillingChunk);
+        inFlight.push_back(fillingChunk);
+    }
+
+    fillingChunk = nullptr;
+    chunkQueued.notify_one();
+}
+
+int ParallelGopEncoder::WriteFinishedChunks(bool waitForAll)
+{
+    int ret = 0;
+
+    while (true)
+    {
+        GopChunk *chunk = nullptr;
+
+        {
+            std::unique_lock<std::mutex> lock(chunkLock);
+
+            if (waitForAll)
+            {
+                chunkEncoded.wait(lock, [this]() { return inFlight.empty() || inFlight.front()->encoded; });
+            }
+
+            //Chunks finish out of order, only the oldest one may be written.
+            if (inFlight.empty() || !inFlight.front()->encoded)
+            {
+                break;
+            }
+
+            chunk = inFlight.front();
+            inFlight.pop_front();
+        }
+
+        for (size_t i = 0; i < chunk->packets.size(); i++)
+        {
+            if (writePacket(&chunk->packets[i]) < 0)
+            {
+                ret = -1;
+            }
+
+            av_packet_unref(&chunk->packets[i]);
+        }
+
+        chunk->packets.clear();
+
+        {
+            std::lock_guard<std::mutex> lock(chunkLock);
+            freeChunks.push_back(chunk);
+        }
+    }
+
+    return ret;
+}
+
+void ParallelGopEncoder::StopWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(chunkLock);
+        stopRequested = true;
+    }
+
+    chunkQueued.notify_all();
+
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        workers[i].join();
+    }
+
+    workers.clear();
+}
+
+AVCodecContext *ParallelGopEncoder::OpenWorkerCodec()
+{
+    AVCodecContext *context = avcodec_alloc_context3(codec);
+    ConfigureVideoCodec(context, codec, &settings, debugLog);
+
+    context->gop_size = chunkFrames;
+
+    //Parallelism comes from the chunks, frame threads inside each context would only compete for cores.
+    context->thread_count = 1;
+
+    if (OpenVideoCodec(context, codec, debugLog) < 0)
+    {
+        avcodec_free_context(&context);
+        return nullptr;
+    }
+
+    return context;
+}
+
+void ParallelGopEncoder::WorkerLoop()
+{
+    TRACE_THREAD_NAME("GopWorker");
+    AVCodecContext *context = OpenWorkerCodec();
+
+    while (true)
+    {
+        GopChunk *chunk = nullptr;
+
+        {
+            std::unique_lock<std::mutex> lock(chunkLock);
+            chunkQueued.wait(lock, [this]() { return stopRequested || !encodeQueue.empty(); });
+
+            if (encodeQueue.empty())
+            {
+                break;
+            }
+
+            chunk = encodeQueue.front();
+            encodeQueue.pop_front();
+        }
+
+        if (context != nullptr)
+        {
+            EncodeChunk(context, chunk);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(chunkLock);
+            chunk->encoded = true;
+        }
+
+        chunkEncoded.notify_all();
+    }
+
+    if (context != nullptr)
+    {
+        avcodec_free_context(&context);
+    }
+}
+
+int ParallelGopEncoder::EncodeChunk(AVCodecContext *context, GopChunk *chunk)
+{
+    TRACE_SCOPE("EncodeChunk", -1);
+
+    for (int i = 0; i < chunk->frameCount; i++)
+    {
+        AVFrame *frame = chunk->frames[i];
+
+        //Every chunk opens with an idr so it decodes without the one before it, scheduled keyframes are kept.
+        if (i == 0)
+        {
+            frame->pict_type = AV_PICTURE_TYPE_I;
+        }
+
+        if (CollectPacket(context, chunk, frame) < 0)
+        {
+            return -1;
+        }
+    }
+
+    //Drain the context so the chunk holds all of its packets, it is reused for a later chunk.
+    if (context->codec->capabilities & CODEC_CAP_DELAY)
+    {
+        while (CollectPacket(context, chunk, NULL) > 0);
+    }
+
+    return 0;
+}
+
+int ParallelGopEncoder::CollectPacket(AVCodecContext *context, GopChunk *chunk, AVFrame *frame)
+{
+    AVPacket pkt;
+    int got_output;
+    av_init_packet(&pkt);
+    pkt.data = NULL;
+    pkt.size = 0;
+
+    int ret = avcodec_encode_video2(context, &pkt, frame, &got_output);
+    if (ret < 0)
+    {
+        LOG_ERROR(debugLog, "Error encoding gop chunk frame");
+        return -1;
+    }
+
+    if (!got_output)
+    {
+        return 0;
+    }
+
+    chunk->packets.push_back(pkt);
+
+    return 1;
+}
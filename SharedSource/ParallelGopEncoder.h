@@ -0,0 +1,67 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "SystemCallbacks.h"
+#include "VideoOutput.h"
+
+//A run of frames that starts with a keyframe and is encoded independently of its neighbours.
+typedef struct GopChunk {
+    int64_t sequence;
+    std::vector<AVFrame*> frames;
+    int frameCount;
+    std::vector<AVPacket> packets;
+    bool encoded;
+} GopChunk;
+
+//Splits the frame stream at fixed gop boundaries and encodes the chunks concurrently,
+//each worker on its own codec context. Packets are handed back in chunk order on the
+//thread that submits frames, so the output file is only ever written from one thread.
+class ParallelGopEncoder {
+    AVCodec *codec;
+    VideoCodecSettings settings;
+    AVPixelFormat pixelFormat;
+    int chunkFrames;
+    int workerCount;
+    int maxChunks;
+    LogCallback debugLog;
+    std::function<int(AVPacket*)> writePacket;
+
+    //Every chunk is allocated up front, maxChunks is the memory bound.
+    std::vector<GopChunk*> chunks;
+    std::deque<GopChunk*> freeChunks;
+    std::deque<GopChunk*> encodeQueue;
+    std::deque<GopChunk*> inFlight;
+    GopChunk *fillingChunk;
+    int64_t nextSequence;
+
+    std::vector<std::thread> workers;
+    std::mutex chunkLock;
+    std::condition_variable chunkQueued;
+    std::condition_variable chunkEncoded;
+    bool stopRequested;
+
+    void WorkerLoop();
+    AVCodecContext *OpenWorkerCodec();
+    int EncodeChunk(AVCodecContext *context, GopChunk *chunk);
+    int CollectPacket(AVCodecContext *context, GopChunk *chunk, AVFrame *frame);
+    void QueueFillingChunk();
+    int WriteFinishedChunks(bool waitForAll);
+    void StopWorkers();
+
+public:
+    ParallelGopEncoder(AVCodec *outputCodec, const VideoCodecSettings *codecSettings, AVPixelFormat format,
+                       int framesPerChunk, int workers, int memoryLimitMB, LogCallback callback);
+    ~ParallelGopEncoder();
+
+    //Global headers of the worker codecs, which all share one configuration, for the stream before its header is written.
+    int CopyExtradata(AVCodecContext *streamContext);
+
+    int Start(std::function<int(AVPacket*)> packetWriter);
+    int Submit(AVFrame *frame);
+    int Flush();
+};
@@ -0,0 +1,77 @@
+#include "PicturePool.h"
+
+extern "C" {
+	#include "libavcodec/avcodec.h"
+	#include "libavutil/mem.h"
+}
+
+PicturePool::PicturePool(int size, int width, int height)
+{
+    int numBytes = avpicture_get_size(AV_PIX_FMT_YUV420P, width, height);
+
+    //Pre-allocate pictures for pool
+    for (int i = 0; i < size; i++)
+    {
+        SharedPicture *picture = new SharedPicture();
+        picture->frame_data = (uint8_t *)av_malloc(numBytes * sizeof(uint8_t));
+        picture->frame = av_frame_alloc();
+        avpicture_fill((AVPicture *)picture->frame, picture->frame_data, AV_PIX_FMT_YUV420P, width, height);
+        picture->frame->format = AV_PIX_FMT_YUV420P;
+        picture->frame->width = width;
+        picture->frame->height = height;
+        picture->pts = 0;
+        picture->gap = 0;
+        picture->keyframe = false;
+        picture->references = 0;
+        picture->owner = this;
+
+        pictures.push_back(picture);
+        freePictures.push_back(picture);
+    }
+}
+
+PicturePool::~PicturePool()
+{
+    for (size_t i = 0; i < pictures.size(); i++)
+    {
+        SharedPicture *picture = pictures[i];
+
+        av_frame_free(&picture->frame);
+        av_free(picture->frame_data);
+        delete picture;
+    }
+}
+
+SharedPicture* PicturePool::Acquire()
+{
+    std::unique_lock<std::mutex> lock(poolLock);
+
+    //Only happens when the slowest rendition falls behind, which keeps every output in sync.
+    pictureReleased.wait(lock, [this]() { return !freePictures.empty(); });
+
+    SharedPicture *picture = freePictures.back();
+    freePictures.pop_back();
+    picture->references = 1;
+
+    return picture;
+}
+
+void PicturePool::Retain(SharedPicture *picture)
+{
+    picture->references.fetch_add(1);
+}
+
+void PicturePool::Release(SharedPicture *picture)
+{
+    if (picture->references.fetch_sub(1) != 1)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(poolLock);
+        freePictures.push_back(picture);
+    }
+
+    pictureReleased.notify_one();
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+
+extern "C" {
+	#include "libavutil/frame.h"
+}
+
+class PicturePool;
+
+//A converted I420 picture that several encoders read at the same time.
+//The last reader to release it hands it back to the pool.
+typedef struct SharedPicture {
+    AVFrame *frame;
+    uint8_t *frame_data;
+    int64_t pts;
+
+    //Same as the main output: empty CFR slots before the picture and whether it starts a new gop.
+    int gap;
+    bool keyframe;
+
+    std::atomic<int> references;
+    PicturePool *owner;
+} SharedPicture;
+
+class PicturePool {
+    std::vector<SharedPicture*> pictures;
+    std::vector<SharedPicture*> freePictures;
+    std::mutex poolLock;
+    std::condition_variable pictureReleased;
+
+public:
+    PicturePool(int size, int width, int height);
+    ~PicturePool();
+
+    //Blocks until a picture is free, the caller holds the first reference.
+    SharedPicture *Acquire();
+    void Retain(SharedPicture *picture);
+    void Release(SharedPicture *picture);
+};
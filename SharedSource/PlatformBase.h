@@ -56,6 +56,11 @@
 #define SUPPORT_METAL 1
 #endif
 
+// Desktop capture outside the engine, needs libX11, libXext and libXdamage.
+#if UNITY_LINUX
+#define SUPPORT_X11_CAPTURE 1
+#endif
+
 
 
 // COM-like Release macro
@@ -8,7 +8,8 @@
 #include <stddef.h>
 #include <stdint.h>
 
-void rgb2yuv420(uint8_t *destination, uint8_t *rgb, int bytesPerPixel, size_t width, size_t height)
+//r and b are the byte offsets of the red and blue channel, so both channel orders share one loop.
+static inline void yuv420_from_packed(uint8_t *destination, const uint8_t *rgb, int bytesPerPixel, int r, int b, size_t width, size_t height)
 {
     size_t image_size = width * height;
     size_t upos = image_size;
@@ -21,34 +22,45 @@ void rgb2yuv420(uint8_t *destination, uint8_t *rgb, int bytesPerPixel, size_t wi
         {
             for( size_t x = 0; x < width; x += 2 )
             {
-                uint8_t r = rgb[bytesPerPixel * i + 0];
-                uint8_t g = rgb[bytesPerPixel * i + 1];
-                uint8_t b = rgb[bytesPerPixel * i + 2];
+                uint8_t red = rgb[bytesPerPixel * i + r];
+                uint8_t green = rgb[bytesPerPixel * i + 1];
+                uint8_t blue = rgb[bytesPerPixel * i + b];
 
-                destination[i++] = ((66*r + 129*g + 25*b) >> 8) + 16;
+                destination[i++] = ((66*red + 129*green + 25*blue) >> 8) + 16;
 
-                destination[upos++] = ((-38*r + -74*g + 112*b) >> 8) + 128;
-                destination[vpos++] = ((112*r + -94*g + -18*b) >> 8) + 128;
+                destination[upos++] = ((-38*red + -74*green + 112*blue) >> 8) + 128;
+                destination[vpos++] = ((112*red + -94*green + -18*blue) >> 8) + 128;
 
-                r = rgb[bytesPerPixel * i + 0];
-                g = rgb[bytesPerPixel * i + 1];
-                b = rgb[bytesPerPixel * i + 2];
+                red = rgb[bytesPerPixel * i + r];
+                green = rgb[bytesPerPixel * i + 1];
+                blue = rgb[bytesPerPixel * i + b];
 
-                destination[i++] = ((66*r + 129*g + 25*b) >> 8) + 16;
+                destination[i++] = ((66*red + 129*green + 25*blue) >> 8) + 16;
             }
         }
         else
         {
             for( size_t x = 0; x < width; x += 1 )
             {
-                uint8_t r = rgb[bytesPerPixel * i + 0];
-                uint8_t g = rgb[bytesPerPixel * i + 1];
-                uint8_t b = rgb[bytesPerPixel * i + 2];
+                uint8_t red = rgb[bytesPerPixel * i + r];
+                uint8_t green = rgb[bytesPerPixel * i + 1];
+                uint8_t blue = rgb[bytesPerPixel * i + b];
 
-                destination[i++] = ((66*r + 129*g + 25*b) >> 8) + 16;
+                destination[i++] = ((66*red + 129*green + 25*blue) >> 8) + 16;
             }
         }
     }
 }
 
+static inline void rgb2yuv420(uint8_t *destination, uint8_t *rgb, int bytesPerPixel, size_t width, size_t height)
+{
+    yuv420_from_packed(destination, rgb, bytesPerPixel, 0, 2, width, height);
+}
+
+//X11 and most desktop surfaces store pixels as bgra.
+static inline void bgr2yuv420(uint8_t *destination, uint8_t *bgr, int bytesPerPixel, size_t width, size_t height)
+{
+    yuv420_from_packed(destination, bgr, bytesPerPixel, 2, 0, width, height);
+}
+
 #endif //ANDROIDNATIVECAPTURING_RGB2YUV420_H
@@ -37,3 +37,73 @@ RenderAPI * CreateRenderAPI(UnityGfxRenderer apiType)
 #endif
 	return NULL;
 }
+
+void RenderAPI::StartReadbackRing()
+{
+	ReadbackSlot empty = { false, 0 };
+	readbackSlots.assign(readbackDepth, empty);
+	submitSlot = 0;
+	collectSlot = 0;
+	readbackStart = 0;
+	readbackOverruns = 0;
+}
+
+void RenderAPI::StopReadbackRing()
+{
+	//Whatever is still in flight is dropped, waiting here would stall the render thread.
+	readbackSlots.clear();
+}
+
+void RenderAPI::ProcessReadbacks(Encoder *encoder, int64_t nowNs)
+{
+	if (readbackSlots.empty())
+	{
+		return;
+	}
+
+	//Timestamps count from the first requested frame.
+	if (readbackStart == 0)
+	{
+		readbackStart = nowNs;
+	}
+
+	int depth = (int)readbackSlots.size();
+
+	//Collect in submission order so timestamps stay monotonic, stop at the first copy still on the GPU.
+	while (readbackSlots[collectSlot].pending && PollReadback(collectSlot))
+	{
+		ReadbackData data;
+
+		if (MapReadback(collectSlot, &data))
+		{
+			if (encoder != nullptr)
+			{
+				encoder->InsertFrameUs((uint8_t*)data.pixels, 4, data.stride, readbackSlots[collectSlot].timeStampUs);
+			}
+
+			UnmapReadback(collectSlot);
+		}
+
+		readbackSlots[collectSlot].pending = false;
+		collectSlot = (collectSlot + 1) % depth;
+	}
+
+	if (!pacer.IsFrameDue(nowNs))
+	{
+		return;
+	}
+
+	//Every slot is still busy, the GPU is further behind than the ring is deep. Skip this frame.
+	if (readbackSlots[submitSlot].pending)
+	{
+		readbackOverruns++;
+		return;
+	}
+
+	if (SubmitReadback(submitSlot))
+	{
+		readbackSlots[submitSlot].pending = true;
+		readbackSlots[submitSlot].timeStampUs = (nowNs - readbackStart) / 1000;
+		submitSlot = (submitSlot + 1) % depth;
+	}
+}
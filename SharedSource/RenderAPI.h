@@ -3,11 +3,20 @@
 #include "SystemCallbacks.h"
 #include "EngineDevice/IUnityGraphics.h"
 #include "Encoder.h"
+#include "FramePacer.h"
 #include <stddef.h>
 #include <string>
+#include <vector>
 
 struct IUnityInterfaces;
 
+//CPU view of a finished readback, rows may be padded or bottom-up with a negative stride.
+struct ReadbackData
+{
+	const uint8_t *pixels;
+	int stride;
+};
+
 class RenderAPI
 {
 public:
@@ -26,6 +35,56 @@ public:
     virtual void StopCapturing() = 0;
 
 	virtual void ReadFrameBuffer() = 0;
+
+	//Stamps the frame index into generated frames while a marker log is recorded, backends that read real frames ignore it.
+	virtual void SetFrameMarkers(bool) { }
+
+	//Capture rate for the pacer, usually the encoder frame rate. Render events in between skip the readback.
+	void SetTargetFramerate(int framerate) { pacer.Start(framerate); }
+
+	int64_t GetSkippedFrames() { return pacer.SkippedFrames(); }
+
+	//Due frames that were not read back because the source reported no change since the last one.
+	int64_t GetUnchangedFrames() { return unchangedFrames; }
+
+	//Number of staging slots in flight, a readback is collected this many frames after it was requested.
+	void SetReadbackDepth(int depth) { readbackDepth = depth > 0 ? depth : 1; }
+
+	int GetReadbackDepth() { return readbackDepth; }
+
+	int64_t GetReadbackOverruns() { return readbackOverruns; }
+
+protected:
+	FramePacer pacer;
+	int64_t unchangedFrames = 0;
+
+	//Asynchronous backends start a GPU to CPU copy into a staging slot, report when it has landed
+	//and map it. The base class drives the ring so the render thread never waits on the GPU.
+	virtual bool SubmitReadback(int) { return false; }
+	virtual bool PollReadback(int) { return false; }
+	virtual bool MapReadback(int, ReadbackData *) { return false; }
+	virtual void UnmapReadback(int) { }
+
+	void StartReadbackRing();
+	void StopReadbackRing();
+
+	//Hands finished readbacks to the encoder, oldest first, then requests one for the current frame
+	//when the pacer says it is due. Called once per render event with the monotonic clock.
+	void ProcessReadbacks(Encoder *encoder, int64_t nowNs);
+
+private:
+	struct ReadbackSlot
+	{
+		bool pending;
+		int64_t timeStampUs;
+	};
+
+	std::vector<ReadbackSlot> readbackSlots;
+	int readbackDepth = 3;
+	int submitSlot = 0;
+	int collectSlot = 0;
+	int64_t readbackStart = 0;
+	int64_t readbackOverruns = 0;
 };
 
 // Create a graphics API implementation instance for the given API type.
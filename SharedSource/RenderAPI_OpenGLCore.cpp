@@ -0,0 +1,262 @@
+#include "RenderAPI.h"
+#include "PlatformBase.h"
+
+#if (SUPPORT_OPENGL_UNIFIED || SUPPORT_OPENGL_LEGACY) && !UNITY_WIN
+
+#include "TimeTools.h"
+#include "Logger.h"
+#include <vector>
+
+#if UNITY_OSX
+#include <OpenGL/gl3.h>
+#elif UNITY_ANDROID || UNITY_WEBGL
+#include <GLES3/gl3.h>
+#else
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+#endif
+
+//Reads the framebuffer through a ring of pixel buffer objects. glReadPixels only queues the copy,
+//the buffer is mapped frames later once its fence has signalled, so the render thread never waits.
+class RenderAPI_OpenGLCore : public RenderAPI
+{
+public:
+	RenderAPI_OpenGLCore(UnityGfxRenderer apiType);
+	virtual ~RenderAPI_OpenGLCore();
+
+	virtual void SetDebugCallback(LogCallback debugLog);
+
+	virtual void SetDebugPath(std::string debugPath);
+
+	virtual void SetExternalEncoder(Encoder *encoder);
+
+	virtual void StartCapturing(int width, int height);
+
+	virtual void StopCapturing();
+
+	virtual void ProcessDeviceEvent(UnityGfxDeviceEventType type, IUnityInterfaces* interfaces);
+
+	virtual void ReadFrameBuffer();
+
+protected:
+	virtual bool SubmitReadback(int slot);
+	virtual bool PollReadback(int slot);
+	virtual bool MapReadback(int slot, ReadbackData *data);
+	virtual void UnmapReadback(int slot);
+
+private:
+	void AllocateBuffers();
+	void ReleaseBuffers();
+
+	UnityGfxRenderer m_apiType;
+	Encoder *m_encoder;
+	LogCallback debugLog;
+	std::string debugPath;
+	int currentWidth;
+	int currentHeight;
+	bool isCapturing;
+
+	//Legacy contexts have no sync objects, a slot is assumed ready once the ring has wrapped around to it.
+	bool useFences;
+	int64_t frameCount;
+
+	std::vector<GLuint> pixelBuffers;
+	std::vector<GLsync> fences;
+	std::vector<int64_t> submitFrame;
+};
+
+RenderAPI* Create_OpenGLCoreCapturer(UnityGfxRenderer apiType)
+{
+	//ES 2.0 has no pixel pack buffers.
+	if (apiType == kUnityGfxRendererOpenGLES20)
+	{
+		return NULL;
+	}
+
+	return new RenderAPI_OpenGLCore(apiType);
+}
+
+RenderAPI* Create_OpenGL2Capturer()
+{
+	return new RenderAPI_OpenGLCore(kUnityGfxRendererOpenGL);
+}
+
+RenderAPI_OpenGLCore::RenderAPI_OpenGLCore(UnityGfxRenderer apiType)
+{
+	m_apiType = apiType;
+	m_encoder = nullptr;
+	debugLog = NULL;
+	currentWidth = 0;
+	currentHeight = 0;
+	isCapturing = false;
+	useFences = apiType != kUnityGfxRendererOpenGL;
+	frameCount = 0;
+}
+
+RenderAPI_OpenGLCore::~RenderAPI_OpenGLCore()
+{
+}
+
+void RenderAPI_OpenGLCore::SetExternalEncoder(Encoder *encoder)
+{
+	m_encoder = encoder;
+}
+
+void RenderAPI_OpenGLCore::StartCapturing(int _width, int _height)
+{
+	//GL objects are created on the render thread with the first render event.
+	currentWidth = _width;
+	currentHeight = _height;
+	isCapturing = true;
+}
+
+void RenderAPI_OpenGLCore::StopCapturing()
+{
+	//Released on the next render event, this is not called with the GL context current.
+	isCapturing = false;
+}
+
+void RenderAPI_OpenGLCore::ReadFrameBuffer()
+{
+	if (!isCapturing)
+	{
+		if (!pixelBuffers.empty()) ReleaseBuffers();
+		return;
+	}
+
+	if (pixelBuffers.empty())
+	{
+		AllocateBuffers();
+	}
+
+	ProcessReadbacks(m_encoder, timenow_ns());
+}
+
+void RenderAPI_OpenGLCore::AllocateBuffers()
+{
+	int depth = GetReadbackDepth();
+	GLsizeiptr size = (GLsizeiptr)currentWidth * currentHeight * 4;
+
+	pixelBuffers.resize(depth);
+	fences.assign(depth, (GLsync)0);
+	submitFrame.assign(depth, 0);
+	frameCount = 0;
+
+	glGenBuffers(depth, pixelBuffers.data());
+
+	for (int i = 0; i < depth; i++)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	StartReadbackRing();
+
+	if (debugLog != NULL) debugLog("Allocated pixel buffer readback ring");
+}
+
+void RenderAPI_OpenGLCore::ReleaseBuffers()
+{
+	StopReadbackRing();
+
+	for (size_t i = 0; i < fences.size(); i++)
+	{
+		if (fences[i] != 0) glDeleteSync(fences[i]);
+	}
+
+	glDeleteBuffers((GLsizei)pixelBuffers.size(), pixelBuffers.data());
+
+	pixelBuffers.clear();
+	fences.clear();
+	submitFrame.clear();
+}
+
+bool RenderAPI_OpenGLCore::SubmitReadback(int slot)
+{
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[slot]);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+	//With a pack buffer bound the pointer is an offset, the call returns as soon as the copy is queued.
+	glReadPixels(0, 0, currentWidth, currentHeight, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	if (useFences)
+	{
+		if (fences[slot] != 0) glDeleteSync(fences[slot]);
+		fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	submitFrame[slot] = frameCount++;
+
+	return true;
+}
+
+bool RenderAPI_OpenGLCore::PollReadback(int slot)
+{
+	if (!useFences)
+	{
+		return frameCount - submitFrame[slot] >= (int64_t)pixelBuffers.size() - 1;
+	}
+
+	//Zero timeout, the flush bit makes sure the fence is actually sent to the GPU.
+	GLenum result = glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+
+	return result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED;
+}
+
+bool RenderAPI_OpenGLCore::MapReadback(int slot, ReadbackData *data)
+{
+	int stride = currentWidth * 4;
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[slot]);
+
+#if UNITY_ANDROID || UNITY_WEBGL || UNITY_OSX
+	void *pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)stride * currentHeight, GL_MAP_READ_BIT);
+#else
+	void *pixels = useFences ?
+		glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)stride * currentHeight, GL_MAP_READ_BIT) :
+		glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+#endif
+
+	if (pixels == NULL)
+	{
+		LOG_WARN(debugLog, "Failed to map pixel buffer");
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		return false;
+	}
+
+	//GL rows are bottom-up, starting at the last row with a negative stride hands out a top-down image without a flip.
+	data->pixels = (const uint8_t*)pixels + (ptrdiff_t)(currentHeight - 1) * stride;
+	data->stride = -stride;
+
+	return true;
+}
+
+void RenderAPI_OpenGLCore::UnmapReadback(int)
+{
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void RenderAPI_OpenGLCore::ProcessDeviceEvent(UnityGfxDeviceEventType eventType, IUnityInterfaces*)
+{
+	if (eventType == kUnityGfxDeviceEventShutdown && !pixelBuffers.empty())
+	{
+		ReleaseBuffers();
+	}
+}
+
+void RenderAPI_OpenGLCore::SetDebugCallback(LogCallback callback)
+{
+	debugLog = callback;
+}
+
+void RenderAPI_OpenGLCore::SetDebugPath(std::string path)
+{
+	debugPath = path;
+}
+
+#endif // if (SUPPORT_OPENGL_UNIFIED || SUPPORT_OPENGL_LEGACY) && !UNITY_WIN
@@ -0,0 +1,260 @@
+#include "RenderAPI.h"
+#include "TimeTools.h"
+#include "FrameMarker.h"
+#include <atomic>
+#include <vector>
+
+//Backend without a GPU. Each requested frame is drawn by a deterministic content generator and
+//completes after a simulated GPU latency, so the whole capture path runs on machines without a
+//graphics device and produces the same video on every run.
+class RenderAPI_Synthetic : public RenderAPI
+{
+public:
+	RenderAPI_Synthetic(int gpuLatencyUs);
+	virtual ~RenderAPI_Synthetic();
+
+	virtual void SetDebugCallback(LogCallback debugLog);
+
+	virtual void SetDebugPath(std::string debugPath);
+
+	virtual void SetExternalEncoder(Encoder *encoder);
+
+	virtual void StartCapturing(int width, int height);
+
+	virtual void StopCapturing();
+
+	virtual void ProcessDeviceEvent(UnityGfxDeviceEventType type, IUnityInterfaces* interfaces);
+
+	virtual void ReadFrameBuffer();
+
+	virtual void SetFrameMarkers(bool enabled);
+
+protected:
+	virtual bool SubmitReadback(int slot);
+	virtual bool PollReadback(int slot);
+	virtual bool MapReadback(int slot, ReadbackData *data);
+	virtual void UnmapReadback(int slot);
+
+private:
+	void DrawStatic(uint8_t *pixels);
+	void DrawGradient(uint8_t *pixels, int64_t frame);
+	void DrawText(uint8_t *pixels, int64_t frame);
+
+	Encoder *m_encoder;
+	LogCallback debugLog;
+	std::string debugPath;
+	int currentWidth;
+	int currentHeight;
+	int64_t gpuLatencyNs;
+	int64_t frameCount;
+	bool isCapturing;
+
+	//Set from the thread that configures the marker log, read on the render thread.
+	std::atomic<bool> stampMarkers;
+
+	//Stand-in for staging textures, each slot holds one rgba frame.
+	std::vector<std::vector<uint8_t> > slotPixels;
+	std::vector<int64_t> slotReadyAt;
+};
+
+RenderAPI* CreateRenderAPI_Synthetic(int gpuLatencyUs)
+{
+	return new RenderAPI_Synthetic(gpuLatencyUs);
+}
+
+static inline uint32_t content_hash(uint32_t x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352d;
+	x ^= x >> 15;
+	x *= 0x846ca68b;
+	x ^= x >> 16;
+	return x;
+}
+
+RenderAPI_Synthetic::RenderAPI_Synthetic(int gpuLatencyUs)
+{
+	m_encoder = nullptr;
+	debugLog = NULL;
+	currentWidth = 0;
+	currentHeight = 0;
+	gpuLatencyNs = (int64_t)gpuLatencyUs * 1000;
+	frameCount = 0;
+	isCapturing = false;
+	stampMarkers = false;
+}
+
+RenderAPI_Synthetic::~RenderAPI_Synthetic()
+{
+}
+
+void RenderAPI_Synthetic::SetExternalEncoder(Encoder *encoder)
+{
+	m_encoder = encoder;
+}
+
+void RenderAPI_Synthetic::StartCapturing(int _width, int _height)
+{
+	currentWidth = _width;
+	currentHeight = _height;
+	frameCount = 0;
+
+	StartReadbackRing();
+
+	slotPixels.assign(GetReadbackDepth(), std::vector<uint8_t>((size_t)_width * _height * 4));
+	slotReadyAt.assign(slotPixels.size(), 0);
+
+	//The static region never changes, draw it once per slot.
+	for (size_t i = 0; i < slotPixels.size(); i++)
+	{
+		DrawStatic(slotPixels[i].data());
+	}
+
+	isCapturing = true;
+}
+
+void RenderAPI_Synthetic::StopCapturing()
+{
+	isCapturing = false;
+
+	StopReadbackRing();
+	slotPixels.clear();
+	slotReadyAt.clear();
+}
+
+void RenderAPI_Synthetic::ReadFrameBuffer()
+{
+	if (!isCapturing) return;
+
+	ProcessReadbacks(m_encoder, timenow_ns());
+}
+
+//Layout: the top half is a gradient moving diagonally, the bottom left quarter a static pattern
+//and the bottom right quarter scrolling text-like glyphs. That gives the encoder motion, fine
+//detail and regions it can skip in every frame.
+void RenderAPI_Synthetic::DrawStatic(uint8_t *pixels)
+{
+	for (int y = currentHeight / 2; y < currentHeight; y++)
+	{
+		uint8_t *row = pixels + (size_t)y * currentWidth * 4;
+
+		for (int x = 0; x < currentWidth / 2; x++)
+		{
+			uint8_t shade = ((x / 32) + (y / 32)) % 2 == 0 ? 200 : 60;
+			row[x * 4 + 0] = shade;
+			row[x * 4 + 1] = (uint8_t)(shade / 2 + x / 8);
+			row[x * 4 + 2] = (uint8_t)(255 - shade);
+			row[x * 4 + 3] = 255;
+		}
+	}
+}
+
+void RenderAPI_Synthetic::DrawGradient(uint8_t *pixels, int64_t frame)
+{
+	int shift = (int)frame;
+
+	for (int y = 0; y < currentHeight / 2; y++)
+	{
+		uint8_t *row = pixels + (size_t)y * currentWidth * 4;
+
+		for (int x = 0; x < currentWidth; x++)
+		{
+			row[x * 4 + 0] = (uint8_t)(x + shift * 4);
+			row[x * 4 + 1] = (uint8_t)(y + shift * 2);
+			row[x * 4 + 2] = (uint8_t)((x + y) / 2 + shift);
+			row[x * 4 + 3] = 255;
+		}
+	}
+}
+
+void RenderAPI_Synthetic::DrawText(uint8_t *pixels, int64_t frame)
+{
+	const int cellWidth = 8;
+	const int cellHeight = 16;
+
+	//A new line of text scrolls in every 8 frames.
+	uint32_t scroll = (uint32_t)(frame / 8);
+
+	for (int y = currentHeight / 2; y < currentHeight; y++)
+	{
+		uint8_t *row = pixels + (size_t)y * currentWidth * 4;
+		uint32_t line = (uint32_t)((y - currentHeight / 2) / cellHeight) + scroll;
+		int glyphRow = (y - currentHeight / 2) % cellHeight;
+
+		for (int cellX = currentWidth / 2, column = 0; cellX < currentWidth; cellX += cellWidth, column++)
+		{
+			uint32_t glyph = content_hash(line * 977 + column) % 96;
+
+			//Glyph 0 is a space, rows at the cell edges stay blank so glyphs don't touch.
+			uint32_t bits = 0;
+			if (glyph != 0 && glyphRow > 2 && glyphRow < cellHeight - 2)
+			{
+				bits = content_hash(glyph * cellHeight + glyphRow) & 0x7e;
+			}
+
+			for (int x = cellX; x < cellX + cellWidth && x < currentWidth; x++)
+			{
+				uint8_t shade = (bits >> (x - cellX)) & 1 ? 20 : 235;
+				row[x * 4 + 0] = shade;
+				row[x * 4 + 1] = shade;
+				row[x * 4 + 2] = shade;
+				row[x * 4 + 3] = 255;
+			}
+		}
+	}
+}
+
+bool RenderAPI_Synthetic::SubmitReadback(int slot)
+{
+	uint8_t *pixels = slotPixels[slot].data();
+
+	DrawGradient(pixels, frameCount);
+	DrawText(pixels, frameCount);
+
+	//Lets a verifier match every decoded frame to the readback it came from.
+	if (stampMarkers)
+	{
+		frame_marker_stamp(pixels, currentWidth * 4, currentWidth, currentHeight, (uint32_t)frameCount);
+	}
+
+	slotReadyAt[slot] = timenow_ns() + gpuLatencyNs;
+	frameCount++;
+
+	return true;
+}
+
+bool RenderAPI_Synthetic::PollReadback(int slot)
+{
+	return timenow_ns() >= slotReadyAt[slot];
+}
+
+bool RenderAPI_Synthetic::MapReadback(int slot, ReadbackData *data)
+{
+	data->pixels = slotPixels[slot].data();
+	data->stride = currentWidth * 4;
+
+	return true;
+}
+
+void RenderAPI_Synthetic::SetFrameMarkers(bool enabled)
+{
+	stampMarkers = enabled;
+}
+
+void RenderAPI_Synthetic::UnmapReadback(int)
+{
+}
+
+void RenderAPI_Synthetic::ProcessDeviceEvent(UnityGfxDeviceEventType, IUnityInterfaces*)
+{
+}
+
+void RenderAPI_Synthetic::SetDebugCallback(LogCallback callback)
+{
+	debugLog = callback;
+}
+
+void RenderAPI_Synthetic::SetDebugPath(std::string path)
+{
+	debugPath = path;
+}
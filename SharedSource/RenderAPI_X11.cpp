@@ -0,0 +1,325 @@
+#include "RenderAPI.h"
+#include "PlatformBase.h"
+
+#if SUPPORT_X11_CAPTURE
+
+#include "TimeTools.h"
+#include "Logger.h"
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include <X11/extensions/Xdamage.h>
+
+//Desktop capture of an X11 screen or window. XShmGetImage copies the pixels into a segment
+//shared with the server and that pointer goes straight to the encoder. XDamage tells which
+//frames changed, unchanged frames are skipped before anything is read back.
+class RenderAPI_X11 : public RenderAPI
+{
+public:
+	RenderAPI_X11(const char *displayName, unsigned long window);
+	virtual ~RenderAPI_X11();
+
+	virtual void SetDebugCallback(LogCallback debugLog);
+
+	virtual void SetDebugPath(std::string debugPath);
+
+	virtual void SetExternalEncoder(Encoder *encoder);
+
+	virtual void StartCapturing(int width, int height);
+
+	virtual void StopCapturing();
+
+	virtual void ProcessDeviceEvent(UnityGfxDeviceEventType type, IUnityInterfaces* interfaces);
+
+	virtual void ReadFrameBuffer();
+
+private:
+	bool OpenDisplay();
+	void CloseDisplay();
+	bool IsDamaged();
+
+	std::string displayName;
+	Window window;
+	Encoder *m_encoder;
+	LogCallback debugLog;
+	std::string debugPath;
+	int currentWidth;
+	int currentHeight;
+	int64_t startTime;
+	int frameCount;
+	bool isCapturing;
+
+	Display *display;
+	Window captureWindow;
+	XImage *image;
+	XShmSegmentInfo shmInfo;
+	CapturePixelOrder pixelOrder;
+
+	//Without the damage extension every due frame is read back.
+	Damage damage;
+	int damageEventBase;
+	bool damaged;
+};
+
+RenderAPI* CreateRenderAPI_X11(const char *displayName, unsigned long window)
+{
+	return new RenderAPI_X11(displayName, window);
+}
+
+RenderAPI_X11::RenderAPI_X11(const char *_displayName, unsigned long _window)
+{
+	displayName = _displayName != NULL ? _displayName : "";
+	window = (Window)_window;
+	m_encoder = nullptr;
+	debugLog = NULL;
+	currentWidth = 0;
+	currentHeight = 0;
+	startTime = 0;
+	frameCount = 0;
+	isCapturing = false;
+	display = NULL;
+	captureWindow = 0;
+	image = NULL;
+	shmInfo.shmaddr = (char*)-1;
+	pixelOrder = PixelOrderBGRA;
+	damage = 0;
+	damageEventBase = 0;
+	damaged = true;
+}
+
+RenderAPI_X11::~RenderAPI_X11()
+{
+	CloseDisplay();
+}
+
+void RenderAPI_X11::SetExternalEncoder(Encoder *encoder)
+{
+	m_encoder = encoder;
+}
+
+void RenderAPI_X11::StartCapturing(int _width, int _height)
+{
+	//Xlib is only used from the thread that reads frames, the display is opened with the first one.
+	currentWidth = _width;
+	currentHeight = _height;
+	frameCount = 0;
+	unchangedFrames = 0;
+	isCapturing = true;
+}
+
+void RenderAPI_X11::StopCapturing()
+{
+	isCapturing = false;
+}
+
+bool RenderAPI_X11::OpenDisplay()
+{
+	display = XOpenDisplay(displayName.empty() ? NULL : displayName.c_str());
+
+	if (display == NULL)
+	{
+		if (debugLog != NULL) debugLog("Could not open X display");
+		return false;
+	}
+
+	if (!XShmQueryExtension(display))
+	{
+		if (debugLog != NULL) debugLog("X server has no MIT-SHM extension");
+		CloseDisplay();
+		return false;
+	}
+
+	captureWindow = window != 0 ? window : DefaultRootWindow(display);
+
+	XWindowAttributes attributes;
+	if (!XGetWindowAttributes(display, captureWindow, &attributes) || attributes.width < currentWidth || attributes.height < currentHeight)
+	{
+		if (debugLog != NULL) debugLog("Capture window is smaller than the capture size");
+		CloseDisplay();
+		return false;
+	}
+
+	//Only 32 bit true color, red decides the channel order as the encoder sees it in memory.
+	Visual *visual = attributes.visual;
+	if (visual->red_mask == 0xff0000 && visual->blue_mask == 0xff)
+	{
+		pixelOrder = PixelOrderBGRA;
+	}
+	else if (visual->red_mask == 0xff && visual->blue_mask == 0xff0000)
+	{
+		pixelOrder = PixelOrderRGBA;
+	}
+	else
+	{
+		if (debugLog != NULL) debugLog("Unsupported X visual, expected 24 or 32 bit true color");
+		CloseDisplay();
+		return false;
+	}
+
+	image = XShmCreateImage(display, visual, attributes.depth, ZPixmap, NULL, &shmInfo, currentWidth, currentHeight);
+
+	if (image == NULL || image->bits_per_pixel != 32 || image->byte_order != LSBFirst)
+	{
+		if (debugLog != NULL) debugLog("Could not create a 32 bit shared memory image");
+		CloseDisplay();
+		return false;
+	}
+
+	shmInfo.shmid = shmget(IPC_PRIVATE, (size_t)image->bytes_per_line * image->height, IPC_CREAT | 0600);
+	shmInfo.shmaddr = image->data = (char*)shmat(shmInfo.shmid, NULL, 0);
+	shmInfo.readOnly = False;
+
+	if (shmInfo.shmaddr == (char*)-1 || !XShmAttach(display, &shmInfo))
+	{
+		if (debugLog != NULL) debugLog("Could not attach shared memory segment");
+		CloseDisplay();
+		return false;
+	}
+
+	//Once the server has attached, the segment can be marked for removal so it never outlives the process.
+	XSync(display, False);
+	shmctl(shmInfo.shmid, IPC_RMID, NULL);
+
+	int damageErrorBase;
+	if (XDamageQueryExtension(display, &damageEventBase, &damageErrorBase))
+	{
+		damage = XDamageCreate(display, captureWindow, XDamageReportNonEmpty);
+	}
+	else
+	{
+		if (debugLog != NULL) debugLog("X server has no DAMAGE extension, reading back every frame");
+	}
+
+	damaged = true;
+
+	if (m_encoder != nullptr)
+	{
+		m_encoder->SetPixelOrder(pixelOrder);
+	}
+
+	return true;
+}
+
+void RenderAPI_X11::CloseDisplay()
+{
+	if (display == NULL)
+	{
+		return;
+	}
+
+	if (damage != 0)
+	{
+		XDamageDestroy(display, damage);
+		damage = 0;
+	}
+
+	if (image != NULL)
+	{
+		if (shmInfo.shmaddr != (char*)-1)
+		{
+			XShmDetach(display, &shmInfo);
+			shmdt(shmInfo.shmaddr);
+			shmInfo.shmaddr = (char*)-1;
+		}
+
+		//The data belongs to the segment, XDestroyImage must not free it.
+		image->data = NULL;
+		XDestroyImage(image);
+		image = NULL;
+	}
+
+	XCloseDisplay(display);
+	display = NULL;
+}
+
+bool RenderAPI_X11::IsDamaged()
+{
+	if (damage == 0)
+	{
+		return true;
+	}
+
+	while (XPending(display) > 0)
+	{
+		XEvent event;
+		XNextEvent(display, &event);
+
+		if (event.type == damageEventBase + XDamageNotify)
+		{
+			damaged = true;
+		}
+	}
+
+	if (!damaged)
+	{
+		return false;
+	}
+
+	//Cleared before the copy, anything drawn while reading back raises a new event.
+	XDamageSubtract(display, damage, None, None);
+	damaged = false;
+
+	return true;
+}
+
+void RenderAPI_X11::ReadFrameBuffer()
+{
+	if (!isCapturing)
+	{
+		if (display != NULL) CloseDisplay();
+		return;
+	}
+
+	if (display == NULL && !OpenDisplay())
+	{
+		isCapturing = false;
+		return;
+	}
+
+	int64_t now = timenow_ns();
+
+	if (!pacer.IsFrameDue(now)) return;
+
+	//Nothing changed, the encoder holds the previous frame until the next insert.
+	if (!IsDamaged())
+	{
+		unchangedFrames++;
+		return;
+	}
+
+	if (!XShmGetImage(display, captureWindow, image, 0, 0, AllPlanes))
+	{
+		LOG_WARN(debugLog, "XShmGetImage failed");
+		return;
+	}
+
+	if (frameCount == 0)
+	{
+		startTime = now;
+	}
+
+	if (m_encoder != nullptr)
+	{
+		m_encoder->InsertFrameUs((uint8_t*)image->data, 4, image->bytes_per_line, (now - startTime) / 1000);
+	}
+
+	frameCount++;
+}
+
+void RenderAPI_X11::ProcessDeviceEvent(UnityGfxDeviceEventType, IUnityInterfaces*)
+{
+}
+
+void RenderAPI_X11::SetDebugCallback(LogCallback callback)
+{
+	debugLog = callback;
+}
+
+void RenderAPI_X11::SetDebugPath(std::string path)
+{
+	debugPath = path;
+}
+
+#endif // if SUPPORT_X11_CAPTURE
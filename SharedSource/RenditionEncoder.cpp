@@ -0,0 +1,272 @@
+#include "RenditionEncoder.h"
+#include "Logger.h"
+#include "Tracer.h"
+
+extern "C" {
+	#include "libavutil/imgutils.h"
+}
+
+RenditionEncoder::RenditionEncoder(std::string file, int outputWidth, int outputHeight, int encodeBitrate, LogCallback callback)
+{
+    videoFile = file;
+    width = outputWidth;
+    height = outputHeight;
+    bitrate = encodeBitrate;
+    sourceTimeBase = av_make_q(1, 1000);
+    lastPts = AV_NOPTS_VALUE;
+    debugLog = callback;
+
+    output = nullptr;
+    codecContext = nullptr;
+    scaleConverter = nullptr;
+    scaledFrame = nullptr;
+    stopRequested = false;
+}
+
+RenditionEncoder::~RenditionEncoder()
+{
+    if (worker.joinable())
+    {
+        Stop();
+    }
+
+    ReleaseOutput();
+}
+
+int RenditionEncoder::Start(int framerate, int gopSize, AVRational pictureTimeBase, TimestampMode timestampMode)
+{
+    sourceTimeBase = pictureTimeBase;
+    lastPts = AV_NOPTS_VALUE;
+
+    output = OpenVideoOutput(videoFile.c_str(), debugLog);
+
+    if (output == nullptr)
+    {
+        if (debugLog != NULL) debugLog("Unable to setup rendition output");
+        return -1;
+    }
+
+    VideoCodecSettings settings;
+    settings.width = width;
+    settings.height = height;
+    settings.framerate = framerate;
+    settings.bitrate = bitrate;
+    settings.globalHeader = (output->formatContext->oformat->flags & AVFMT_GLOBALHEADER) != 0;
+    //Keyframes follow the main output, gop length included, so every output can be cut at the same points.
+    settings.gopSize = gopSize;
+    settings.lowLatency = false;
+    settings.slices = 0;
+    settings.preset = NULL;
+    settings.crf = 0;
+
+    //The rendition codec may not accept the main output time base, e.g. mpeg4 or gif next to h264.
+    settings.timeBase = TimestampEngine::CodecTimeBase(timestampMode, output->codec->id, framerate);
+
+    codecContext = avcodec_alloc_context3(output->codec);
+    ConfigureVideoCodec(codecContext, output->codec, &settings, debugLog);
+
+    if (OpenVideoCodec(codecContext, output->codec, debugLog) < 0)
+    {
+        ReleaseOutput();
+        return -1;
+    }
+
+    AVStream *videoStream = output->stream;
+    if (avcodec_copy_context(videoStream->codec, codecContext) < 0)
+    {
+        if (debugLog != NULL) debugLog("Failed to copy codec parameters to rendition stream");
+    }
+    videoStream->codec->codec_tag = 0;
+    videoStream->time_base = codecContext->time_base;
+
+    if (avio_open(&output->formatContext->pb, videoFile.c_str(), AVIO_FLAG_WRITE) < 0)
+    {
+        if (debugLog != NULL) debugLog("Failed to open rendition file!");
+        ReleaseOutput();
+        return -1;
+    }
+
+    if (avformat_write_header(output->formatContext, NULL) < 0)
+    {
+        if (debugLog != NULL) debugLog("Error occurred when writing header data to rendition file");
+        ReleaseOutput();
+        return -1;
+    }
+
+    //Downscale and convert to the codec pixel format in one pass, e.g. RGB8 for gif.
+    scaledFrame = av_frame_alloc();
+    scaledFrame->format = codecContext->pix_fmt;
+    scaledFrame->width = width;
+    scaledFrame->height = height;
+    av_image_alloc(scaledFrame->data, scaledFrame->linesize, width, height, codecContext->pix_fmt, 1);
+
+    stopRequested = false;
+    worker = std::thread(&RenditionEncoder::Run, this);
+
+    return 0;
+}
+
+void RenditionEncoder::Submit(SharedPicture *picture)
+{
+    //The caller has already retained the picture for us.
+    {
+        std::lock_guard<std::mutex> lock(queueLock);
+        pendingPictures.push_back(picture);
+    }
+
+    queueChanged.notify_one();
+}
+
+void RenditionEncoder::Run()
+{
+    TRACE_THREAD_NAME("Rendition");
+    
+    while (true)
+    {
+        SharedPicture *picture = nullptr;
+
+        {
+            std::unique_lock<std::mutex> lock(queueLock);
+            queueChanged.wait(lock, [this]() { return stopRequested || !pendingPictures.empty(); });
+
+            //Stop only once everything that was submitted has been encoded.
+            if (pendingPictures.empty())
+            {
+                break;
+            }
+
+            picture = pendingPictures.front();
+            pendingPictures.pop_front();
+        }
+
+        TRACE_SCOPE("RenditionFrame", picture->pts);
+
+        //The previous picture is still scaled, it fills the slots the capture skipped like in the main output.
+        if (lastPts != AV_NOPTS_VALUE)
+        {
+            for (int i = picture->gap; i > 0; i--)
+            {
+                EncodeScaled(picture->pts - i, false);
+            }
+        }
+
+        //Pictures follow the capture region, the scaler is rebuilt only when its size changes.
+        scaleConverter = sws_getCachedContext(scaleConverter, picture->frame->width, picture->frame->height, AV_PIX_FMT_YUV420P,
+                                              width, height, codecContext->pix_fmt, SWS_BILINEAR, NULL, NULL, NULL);
+
+        sws_scale(scaleConverter,
+                  (const uint8_t * const *)picture->frame->data,
+                  picture->frame->linesize,
+                  0,
+                  picture->frame->height,
+                  scaledFrame->data,
+                  scaledFrame->linesize);
+
+        int64_t picturePts = picture->pts;
+        bool keyframe = picture->keyframe;
+
+        //The shared picture is free for the next capture as soon as it is scaled.
+        picture->owner->Release(picture);
+
+        EncodeScaled(picturePts, keyframe);
+    }
+}
+
+int RenditionEncoder::EncodeScaled(int64_t picturePts, bool keyframe)
+{
+    //Pictures carry main output pts, a coarser time base can round two of them onto one tick.
+    int64_t pts = av_rescale_q(picturePts, sourceTimeBase, codecContext->time_base);
+    if (lastPts != AV_NOPTS_VALUE && pts <= lastPts)
+    {
+        pts = lastPts + 1;
+    }
+    lastPts = pts;
+
+    scaledFrame->pts = pts;
+    scaledFrame->pict_type = keyframe ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+
+    return EncodeFrame(scaledFrame);
+}
+
+int RenditionEncoder::EncodeFrame(AVFrame *frame)
+{
+    AVPacket pkt;
+    int got_output;
+    av_init_packet(&pkt);
+    pkt.data = NULL;
+    pkt.size = 0;
+
+    int ret = avcodec_encode_video2(codecContext, &pkt, frame, &got_output);
+    if (ret < 0)
+    {
+        LOG_ERROR(debugLog, "Error encoding rendition frame");
+        return -1;
+    }
+
+    if (!got_output)
+    {
+        return 0;
+    }
+
+    pkt.stream_index = output->stream->index;
+    av_packet_rescale_ts(&pkt, codecContext->time_base, output->stream->time_base);
+
+    ret = av_write_frame(output->formatContext, &pkt);
+    av_packet_unref(&pkt);
+
+    if (ret < 0)
+    {
+        LOG_ERROR(debugLog, "Error while writing rendition frame");
+        return -1;
+    }
+
+    return 1;
+}
+
+int RenditionEncoder::Stop()
+{
+    if (!worker.joinable())
+    {
+        return -1;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queueLock);
+        stopRequested = true;
+    }
+
+    queueChanged.notify_one();
+    worker.join();
+
+    //Drain delayed frames from the codec.
+    if (codecContext->codec->capabilities & CODEC_CAP_DELAY)
+    {
+        while (EncodeFrame(NULL) > 0);
+    }
+
+    av_write_trailer(output->formatContext);
+
+    ReleaseOutput();
+
+    return 0;
+}
+
+void RenditionEncoder::ReleaseOutput()
+{
+    CloseVideoOutput(output, debugLog);
+    output = nullptr;
+
+    if (codecContext)
+    {
+        avcodec_free_context(&codecContext);
+    }
+
+    sws_freeContext(scaleConverter);
+    scaleConverter = nullptr;
+
+    if (scaledFrame)
+    {
+        av_freep(&scaledFrame->data[0]);
+        av_frame_free(&scaledFrame);
+    }
+}
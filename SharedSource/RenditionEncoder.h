@@ -0,0 +1,51 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "PicturePool.h"
+#include "SystemCallbacks.h"
+#include "TimestampEngine.h"
+#include "VideoOutput.h"
+
+extern "C" {
+	#include "libswscale/swscale.h"
+}
+
+//One extra output of a recording at its own resolution, e.g. 720p, 360p or a gif preview.
+//It downscales the shared I420 capture picture and encodes it on its own thread into its own file.
+class RenditionEncoder {
+    std::string videoFile;
+    int width;
+    int height;
+    int bitrate;
+    AVRational sourceTimeBase;
+    int64_t lastPts;
+    LogCallback debugLog;
+
+    EncodeStream *output;
+    AVCodecContext *codecContext;
+    struct SwsContext *scaleConverter;
+    AVFrame *scaledFrame;
+
+    std::thread worker;
+    std::mutex queueLock;
+    std::condition_variable queueChanged;
+    std::deque<SharedPicture*> pendingPictures;
+    bool stopRequested;
+
+    void Run();
+    int EncodeFrame(AVFrame *frame);
+    int EncodeScaled(int64_t picturePts, bool keyframe);
+    void ReleaseOutput();
+
+public:
+    RenditionEncoder(std::string file, int outputWidth, int outputHeight, int encodeBitrate, LogCallback callback);
+    ~RenditionEncoder();
+
+    int Start(int framerate, int gopSize, AVRational pictureTimeBase, TimestampMode timestampMode);
+    void Submit(SharedPicture *picture);
+    int Stop();
+};
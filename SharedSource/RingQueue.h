@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+//First in first out queue with a fixed capacity set up front, unlike std::queue it never allocates once reserved.
+//Not thread safe, callers hold their own lock like they would around a std::queue.
+template <typename T>
+class RingQueue
+{
+public:
+    RingQueue()
+    {
+        head = 0;
+        count = 0;
+    }
+
+    //Drops whatever is queued.
+    void Reserve(size_t capacity)
+    {
+        items.assign(capacity, T());
+        head = 0;
+        count = 0;
+    }
+
+    //False when full, the item is not queued.
+    bool push(const T &item)
+    {
+        if (count == items.size())
+        {
+            return false;
+        }
+
+        items[(head + count) % items.size()] = item;
+        count++;
+
+        return true;
+    }
+
+    T &front()
+    {
+        return items[head];
+    }
+
+    void pop()
+    {
+        head = (head + 1) % items.size();
+        count--;
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    size_t capacity() const
+    {
+        return items.size();
+    }
+
+    bool empty() const
+    {
+        return count == 0;
+    }
+
+    void clear()
+    {
+        head = 0;
+        count = 0;
+    }
+
+private:
+    std::vector<T> items;
+    size_t head;
+    size_t count;
+};
@@ -1,7 +1,13 @@
 #pragma once
 
+#include <stdint.h>
+
 #ifdef _WIN32
 typedef void(__stdcall *LogCallback)(const char* message);
+typedef void(__stdcall *NalUnitCallback)(const uint8_t* data, int size, int64_t ptsUs, int keyframe, int lastUnit);
+typedef void(__stdcall *StopCallback)(int encoderHandle, int result, int64_t frames, int64_t bytes, int64_t durationUs);
 #else
-typedef void(__cdecl *LogCallback)(const char* message);
+typedef void(*LogCallback)(const char* message);
+typedef void(*NalUnitCallback)(const uint8_t* data, int size, int64_t ptsUs, int keyframe, int lastUnit);
+typedef void(*StopCallback)(int encoderHandle, int result, int64_t frames, int64_t bytes, int64_t durationUs);
 #endif
@@ -1,17 +1,42 @@
 #include "TimeTools.h"
-#include <Windows.h>
 #include <sys/types.h>
 
-int64_t timenow_ms()
+#ifdef _WIN32
+#include <Windows.h>
+
+static int64_t query_frequency()
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+
+	return frequency.QuadPart;
+}
+#else
+#include <time.h>
+#endif
+
+int64_t timenow_ns()
 {
-	LARGE_INTEGER cTime;
-	FILETIME fTime;
-	SYSTEMTIME currentTime;
-	GetSystemTime(&currentTime);
+#ifdef _WIN32
+	static const int64_t frequency = query_frequency();
+
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
 
-	SystemTimeToFileTime(&currentTime, &fTime);
-	cTime.HighPart = fTime.dwHighDateTime;
-	cTime.LowPart = fTime.dwLowDateTime;
+	//Split into seconds first so the multiplication can not overflow.
+	int64_t seconds = counter.QuadPart / frequency;
+	int64_t remainder = counter.QuadPart % frequency;
 
-	return cTime.QuadPart / 10000;
+	return seconds * 1000000000 + remainder * 1000000000 / frequency;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+int64_t timenow_ms()
+{
+	return timenow_ns() / 1000000;
 }
@@ -4,10 +4,12 @@
 #ifndef TIME_TOOLS_H
 #define TIME_TOOLS_H
 
-#include <Windows.h>
 #include <sys/types.h>
 #include <cstdint>
 
+//Monotonic clock, never jumps with wall clock or NTP adjustments. Only differences are meaningful.
+int64_t timenow_ns();
+
 int64_t timenow_ms();
 
 #endif //TIME_TOOLS_H
@@ -0,0 +1,111 @@
+#include "TimestampEngine.h"
+
+extern "C" {
+	#include "libavutil/mathematics.h"
+}
+
+static const AVRational microseconds = { 1, 1000000 };
+
+TimestampEngine::TimestampEngine()
+{
+    AVRational defaultTimeBase = { 1, 30 };
+    Reset(TimestampVFR, 30, defaultTimeBase);
+}
+
+void TimestampEngine::Reset(TimestampMode timestampMode, int outputFramerate, AVRational codecTimeBase)
+{
+    mode = timestampMode;
+    framerate = outputFramerate > 0 ? outputFramerate : 30;
+    timeBase = codecTimeBase;
+
+    firstTimestamp = AV_NOPTS_VALUE;
+    lastPts = AV_NOPTS_VALUE;
+    nextSlot = 0;
+
+    pendingFirst = AV_NOPTS_VALUE;
+    pendingPts = AV_NOPTS_VALUE;
+    pendingSlot = 0;
+}
+
+int TimestampEngine::Assign(int64_t timeStampUs, int64_t *pts, int *gap)
+{
+    //Every recording starts at zero, whatever clock the capturer uses.
+    pendingFirst = firstTimestamp == AV_NOPTS_VALUE ? timeStampUs : firstTimestamp;
+    *gap = 0;
+
+    int64_t elapsed = timeStampUs - pendingFirst;
+
+    if (mode == TimestampCFR)
+    {
+        //Nearest grid slot, a frame landing on a slot that is already filled is dropped.
+        int64_t slot = (elapsed * framerate + 500000) / 1000000;
+
+        if (slot < nextSlot)
+        {
+            return 0;
+        }
+
+        //Capture skipped slots, they are filled with the previous picture.
+        int64_t emptySlots = slot - nextSlot;
+        *gap = (int)(emptySlots < framerate ? emptySlots : framerate);
+        *pts = av_rescale_q(slot, av_make_q(1, framerate), timeBase);
+        pendingSlot = slot;
+
+        return 1;
+    }
+
+    int64_t framePts = av_rescale_q(elapsed, microseconds, timeBase);
+
+    //Coarse codec time bases can round two captures onto the same tick.
+    if (lastPts != AV_NOPTS_VALUE && framePts <= lastPts)
+    {
+        framePts = lastPts + 1;
+    }
+
+    pendingPts = framePts;
+    *pts = framePts;
+
+    return 1;
+}
+
+void TimestampEngine::Commit()
+{
+    firstTimestamp = pendingFirst;
+
+    if (mode == TimestampCFR)
+    {
+        nextSlot = pendingSlot + 1;
+    }
+    else
+    {
+        lastPts = pendingPts;
+    }
+}
+
+int64_t TimestampEngine::FrameDuration()
+{
+    int64_t duration = av_rescale_q(1, av_make_q(1, framerate), timeBase);
+    return duration > 0 ? duration : 1;
+}
+
+AVRational TimestampEngine::CodecTimeBase(TimestampMode timestampMode, AVCodecID codecId, int outputFramerate)
+{
+    if (timestampMode == TimestampCFR)
+    {
+        return av_make_q(1, outputFramerate);
+    }
+
+    switch (codecId)
+    {
+    case AV_CODEC_ID_H264:
+        return microseconds;
+
+    case AV_CODEC_ID_GIF:
+        //Gif frame delays are stored in centiseconds.
+        return av_make_q(1, 100);
+
+    default:
+        //Mpeg4 only allows a 16 bit time base denominator.
+        return av_make_q(1, 1000);
+    }
+}
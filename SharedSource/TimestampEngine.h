@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+extern "C" {
+	#include "libavcodec/avcodec.h"
+}
+
+//VFR keeps the capture time of every frame, CFR places frames on a fixed grid of 1/framerate.
+enum TimestampMode { TimestampVFR = 0, TimestampCFR = 1 };
+
+//Turns capture timestamps in microseconds into codec pts. Runs on the thread that inserts frames,
+//so frames that CFR is going to drop are rejected before they are copied or converted.
+class TimestampEngine {
+    TimestampMode mode;
+    AVRational timeBase;
+    int framerate;
+
+    int64_t firstTimestamp;
+    int64_t lastPts;
+    int64_t nextSlot;
+
+    //Result of the last Assign, applied by Commit.
+    int64_t pendingFirst;
+    int64_t pendingPts;
+    int64_t pendingSlot;
+
+public:
+    TimestampEngine();
+
+    void Reset(TimestampMode timestampMode, int outputFramerate, AVRational codecTimeBase);
+
+    //Returns 0 to drop the frame, 1 to encode it at *pts. In CFR *gap counts the empty grid slots right before it,
+    //the encoder fills them with the previous picture so new content never shows before it was captured.
+    //The gap is capped at one second, after a longer stall the previous picture is simply held longer.
+    //Nothing changes until Commit, a frame that can not be queued leaves its slot to the next one.
+    int Assign(int64_t timeStampUs, int64_t *pts, int *gap);
+    void Commit();
+
+    //One nominal frame in codec time base, used when the codec does not report a pts.
+    int64_t FrameDuration();
+
+    //Codec time base for a mode. VFR uses microseconds where the codec allows it.
+    static AVRational CodecTimeBase(TimestampMode timestampMode, AVCodecID codecId, int outputFramerate);
+};
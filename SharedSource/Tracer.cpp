@@ -0,0 +1,194 @@
+#include "Tracer.h"
+#include <stdio.h>
+#include <string.h>
+#include <mutex>
+#include <vector>
+
+//About 2 MB per recording thread, enough for several minutes of capture at 60 fps. Later events are counted and dropped.
+#define TRACE_EVENTS_PER_THREAD 65536
+
+struct TraceEvent
+{
+    const char *name;
+    int64_t startNs;
+    int64_t endNs;
+    int64_t arg;
+};
+
+//Written only by its own thread. The count is published with release so Stop can read up to it while the thread keeps going.
+struct TraceBuffer
+{
+    int threadId;
+    const char *threadName;
+    std::atomic<int> generation;
+    std::atomic<int> count;
+    std::atomic<int64_t> dropped;
+    std::atomic<bool> retired;
+    TraceEvent events[TRACE_EVENTS_PER_THREAD];
+};
+
+//Marks the buffer of an exiting thread, it is kept until its events were written.
+struct TraceThreadSlot
+{
+    TraceBuffer *buffer = nullptr;
+
+    ~TraceThreadSlot()
+    {
+        if (buffer != nullptr)
+        {
+            buffer->retired = true;
+        }
+    }
+};
+
+std::atomic<bool> Tracer::active(false);
+
+static std::mutex registryLock;
+static std::vector<TraceBuffer*> buffers;
+static std::atomic<int> generation(0);
+static int nextThreadId = 1;
+static int64_t traceStartNs = 0;
+
+static thread_local TraceThreadSlot threadSlot;
+
+static TraceBuffer *thread_buffer()
+{
+    TraceBuffer *buffer = threadSlot.buffer;
+
+    if (buffer == nullptr)
+    {
+        buffer = new TraceBuffer();
+        buffer->threadName = nullptr;
+        buffer->generation = generation.load();
+        buffer->count = 0;
+        buffer->dropped = 0;
+        buffer->retired = false;
+
+        std::lock_guard<std::mutex> lock(registryLock);
+        buffer->threadId = nextThreadId++;
+        buffers.push_back(buffer);
+        threadSlot.buffer = buffer;
+    }
+
+    //First event of a new trace, drop what the thread recorded for the last one.
+    int current = generation.load(std::memory_order_acquire);
+
+    if (buffer->generation.load(std::memory_order_relaxed) != current)
+    {
+        buffer->count.store(0, std::memory_order_relaxed);
+        buffer->dropped.store(0, std::memory_order_relaxed);
+        buffer->generation.store(current, std::memory_order_release);
+    }
+
+    return buffer;
+}
+
+void Tracer::Start()
+{
+    std::lock_guard<std::mutex> lock(registryLock);
+
+    //Threads that exited since the last trace have nothing left to write.
+    for (size_t i = 0; i < buffers.size();)
+    {
+        if (buffers[i]->retired)
+        {
+            delete buffers[i];
+            buffers.erase(buffers.begin() + i);
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    traceStartNs = timenow_ns();
+    generation++;
+    active = true;
+}
+
+void Tracer::Record(const char *name, int64_t startNs, int64_t endNs, int64_t arg)
+{
+    TraceBuffer *buffer = thread_buffer();
+    int index = buffer->count.load(std::memory_order_relaxed);
+
+    if (index >= TRACE_EVENTS_PER_THREAD)
+    {
+        buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    TraceEvent *event = &buffer->events[index];
+    event->name = name;
+    event->startNs = startNs;
+    event->endNs = endNs;
+    event->arg = arg;
+
+    buffer->count.store(index + 1, std::memory_order_release);
+}
+
+void Tracer::NameThread(const char *name)
+{
+    thread_buffer()->threadName = name;
+}
+
+int Tracer::Stop(const char *path)
+{
+    active = false;
+
+    std::lock_guard<std::mutex> lock(registryLock);
+
+    FILE *file = fopen(path, "w");
+
+    if (file == NULL)
+    {
+        return -1;
+    }
+
+    int current = generation.load();
+    int64_t dropped = 0;
+    bool first = true;
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    for (size_t i = 0; i < buffers.size(); i++)
+    {
+        TraceBuffer *buffer = buffers[i];
+
+        if (buffer->generation.load(std::memory_order_acquire) != current)
+        {
+            continue;
+        }
+
+        int count = buffer->count.load(std::memory_order_acquire);
+        dropped += buffer->dropped;
+
+        if (buffer->threadName != nullptr)
+        {
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                    first ? "" : ",\n", buffer->threadId, buffer->threadName);
+            first = false;
+        }
+
+        //Chrome trace timestamps are microseconds, fractions keep the nanosecond resolution.
+        for (int e = 0; e < count; e++)
+        {
+            const TraceEvent *event = &buffer->events[e];
+
+            fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                    first ? "" : ",\n", event->name, buffer->threadId,
+                    (event->startNs - traceStartNs) / 1000.0, (event->endNs - event->startNs) / 1000.0);
+
+            if (event->arg >= 0)
+            {
+                fprintf(file, ",\"args\":{\"frame\":%lld}", (long long)event->arg);
+            }
+
+            fprintf(file, "}");
+            first = false;
+        }
+    }
+
+    fprintf(file, "\n],\"otherData\":{\"droppedEvents\":\"%lld\"}}\n", (long long)dropped);
+
+    return fclose(file) == 0 ? 0 : -1;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include "TimeTools.h"
+
+//Per-frame pipeline timeline. Scoped events are appended to a buffer owned by the recording thread,
+//at the end of a trace they are written as Chrome trace JSON, which chrome://tracing and ui.perfetto.dev open as is.
+//
+//  TRACE_SCOPE("EncodeFrame", frame->pts);
+//
+//The argument shows up as "frame" in the event details so one frame can be followed across threads, -1 leaves it out.
+//While no trace runs a scope costs one relaxed load, building with TRACE_COMPILED 0 removes them entirely.
+
+#ifndef TRACE_COMPILED
+#define TRACE_COMPILED 1
+#endif
+
+class Tracer
+{
+public:
+    //Starts a new trace, events left over from the previous one are discarded. One trace at a time.
+    static void Start();
+
+    //Stops recording and writes everything recorded since Start. Returns -1 when the file can not be written.
+    static int Stop(const char *path);
+
+    static inline bool Active()
+    {
+        return active.load(std::memory_order_relaxed);
+    }
+
+    static void Record(const char *name, int64_t startNs, int64_t endNs, int64_t arg);
+
+    //Label for the calling thread in the trace viewer, the name must outlive the trace.
+    static void NameThread(const char *name);
+
+private:
+    static std::atomic<bool> active;
+};
+
+class TraceScope
+{
+public:
+    TraceScope(const char *scopeName, int64_t scopeArg)
+    {
+        name = scopeName;
+        arg = scopeArg;
+        startNs = Tracer::Active() ? timenow_ns() : 0;
+    }
+
+    //For scopes that only learn which frame they handle part way through.
+    void SetArg(int64_t scopeArg)
+    {
+        arg = scopeArg;
+    }
+
+    ~TraceScope()
+    {
+        if (startNs != 0)
+        {
+            Tracer::Record(name, startNs, timenow_ns(), arg);
+        }
+    }
+
+private:
+    const char *name;
+    int64_t arg;
+    int64_t startNs;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#if TRACE_COMPILED
+#define TRACE_SCOPE(name, arg) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name, arg)
+//For stages that already take their own timestamps, saves reading the clock twice more.
+#define TRACE_COMPLETE(name, startNs, endNs, arg) do { if (Tracer::Active()) Tracer::Record(name, startNs, endNs, arg); } while (0)
+#define TRACE_THREAD_NAME(name) Tracer::NameThread(name)
+#define TRACE_FRAME_SCOPE(name) TraceScope traceFrameScope(name, -1)
+#define TRACE_FRAME(arg) traceFrameScope.SetArg(arg)
+#else
+#define TRACE_SCOPE(name, arg) do { } while (0)
+#define TRACE_COMPLETE(name, startNs, endNs, arg) do { } while (0)
+#define TRACE_THREAD_NAME(name) do { } while (0)
+#define TRACE_FRAME_SCOPE(name) do { } while (0)
+#define TRACE_FRAME(arg) do { } while (0)
+#endif
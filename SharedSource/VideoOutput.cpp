@@ -0,0 +1,194 @@
+#include "VideoOutput.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+EncodeStream* OpenVideoOutput(const char *file, LogCallback debugLog, AVCodecID preferredCodec) {
+    AVFormatContext *outputFormatCtx = NULL;
+    avformat_alloc_output_context2(&outputFormatCtx, NULL, NULL, file);
+    if (!outputFormatCtx) {
+        if (debugLog != NULL)
+        {
+            char buffer [100];
+            snprintf(buffer, 100, "Unable to allocate output context: %s", file);
+            debugLog(buffer);
+        }
+
+        return nullptr;
+    }
+
+    AVOutputFormat *outputFormat = NULL;
+    outputFormat = outputFormatCtx->oformat;
+
+    AVCodecID codecId = outputFormat->video_codec;
+    
+    if (preferredCodec != AV_CODEC_ID_NONE && avformat_query_codec(outputFormat, preferredCodec, FF_COMPLIANCE_NORMAL) == 1 &&
+        avcodec_find_encoder(preferredCodec) != NULL)
+    {
+        codecId = preferredCodec;
+    }
+
+    //Since we cant use assembly level optimization on x86 mpeg4 is actually a faster codec.
+    AVCodec *videoCodec = avcodec_find_encoder(codecId);
+
+    if (!videoCodec) {
+        if (debugLog != NULL) debugLog("Could not find video codec");
+        avformat_free_context(outputFormatCtx);
+        return nullptr;
+    }
+
+    AVStream *videoStream = avformat_new_stream(outputFormatCtx, videoCodec);
+    if (!videoStream) {
+        if (debugLog != NULL) debugLog("Could not allocate video inputStream");
+        avformat_free_context(outputFormatCtx);
+        return nullptr;
+    }
+    videoStream->id = 1;
+
+    EncodeStream *params = (EncodeStream*)malloc((sizeof(EncodeStream)));
+    params->formatContext = outputFormatCtx;
+    params->stream = videoStream;
+    params->codec = videoCodec;
+    params->picture_buffer = nullptr;
+    params->outputFrame = nullptr;
+
+    if (debugLog != NULL)
+    {
+        if (debugLog != NULL) debugLog("Success in creating output context");
+
+        char buffer [100];
+        snprintf(buffer, 100, "Video Codec: %s", params->codec->long_name);
+        debugLog(buffer);
+    }
+
+    return params;
+}
+
+void CloseVideoOutput(EncodeStream *output, LogCallback debugLog)
+{
+    if (output == nullptr)
+    {
+        return;
+    }
+
+    if (output->formatContext){
+        if (debugLog != NULL) debugLog("Close output file");
+        avio_closep(&output->formatContext->pb);
+
+        if (debugLog != NULL) debugLog("Free output context");
+        avformat_free_context(output->formatContext);
+    }
+
+    free(output);
+}
+
+int ConfigureVideoCodec(AVCodecContext *outputContext, AVCodec *codec, const VideoCodecSettings *settings, LogCallback debugLog)
+{
+    //Initialize the selected codec context with preferred values.
+    avcodec_get_context_defaults3(outputContext, codec);
+
+    outputContext->codec_id = codec->id;
+    outputContext->bit_rate = settings->bitrate;
+    outputContext->width    = settings->width;     //Resolution must be a multiple of two.
+    outputContext->height   = settings->height;    //Resolution must be a multiple of two.
+
+    //Pts follow the capture clock, the framerate only guides rate control.
+    outputContext->time_base = settings->timeBase;
+    outputContext->framerate = av_make_q(settings->framerate, 1);
+    outputContext->gop_size      = settings->gopSize > 0 ? settings->gopSize : 12;
+    outputContext->pix_fmt       = AV_PIX_FMT_YUV420P;
+    outputContext->max_b_frames = 0;
+
+	switch (outputContext->codec_id)
+	{
+	case AV_CODEC_ID_H264:
+		outputContext->qblur = 0.0f;
+		if (settings->crf > 0)
+		{
+			//The qp clamp below would cut most of the crf range off.
+			outputContext->bit_rate = 0;
+			av_opt_set_int(outputContext->priv_data, "crf", settings->crf, 0);
+		}
+		else
+		{
+			outputContext->qmin = 18;
+			outputContext->qmax = 28;
+		}
+		//Faster encoder will result in larger output file. A slower preset will result in smaller filesize but slower encoding.
+		av_opt_set(outputContext->priv_data, "preset", settings->preset != NULL ? settings->preset : "ultrafast", 0);
+		//Keyframes forced at the start of a reused session must be real IDR frames.
+		av_opt_set(outputContext->priv_data, "forced-idr", "1", 0);
+		if (settings->lowLatency)
+		{
+			//No lookahead or frame threads, a rolling intra refresh replaces large idr frames.
+			av_opt_set(outputContext->priv_data, "tune", "zerolatency", 0);
+			av_opt_set(outputContext->priv_data, "intra-refresh", "1", 0);
+			outputContext->slices = settings->slices;
+		}
+		break;
+	case AV_CODEC_ID_MPEG4:
+		outputContext->qmin = 3;
+		outputContext->qmax = 10;
+		outputContext->qblur = 0.1f;
+		if (settings->crf > 0)
+		{
+			//Fixed quantizer, 2 is the best quality and 31 the smallest file.
+			outputContext->flags |= CODEC_FLAG_QSCALE;
+			outputContext->global_quality = FF_QP2LAMBDA * settings->crf;
+			outputContext->qmin = 2;
+			outputContext->qmax = 31;
+		}
+		break;
+
+	case AV_CODEC_ID_GIF:
+		outputContext->gop_size = 1;
+		outputContext->bit_rate = 400000;
+		outputContext->pix_fmt = AV_PIX_FMT_RGB8;
+		break;
+	}
+
+    if (outputContext->codec_id == AV_CODEC_ID_MPEG2VIDEO) {
+        outputContext->max_b_frames = 2;
+        if (debugLog != NULL) debugLog("Using AV_CODEC_ID_MPEG2VIDEO");
+    }
+
+    if (outputContext->codec_id == AV_CODEC_ID_MPEG1VIDEO) {
+        /* Needed to avoid using macroblocks in which some coeffs overflow.
+         * This does not happen with normal video, it just happens here as
+         * the motion of the chroma plane does not match the luma plane. */
+        outputContext->mb_decision = 2;
+        if (debugLog != NULL) debugLog("Using AV_CODEC_ID_MPEG1VIDEO");
+    }
+
+    //Some formats want inputStream headers to be separate.
+    if (settings->globalHeader){
+        if (debugLog != NULL) debugLog("Add separate video stream headers");
+        outputContext->flags |= CODEC_FLAG_GLOBAL_HEADER;
+    }
+
+    return 0;
+}
+
+int OpenVideoCodec(AVCodecContext *outputContext, AVCodec *codec, LogCallback debugLog){
+
+    if (debugLog != NULL)
+    {
+        char buffer [100];
+        snprintf(buffer, 100, "Opening video codec: %s", codec->long_name);
+        debugLog(buffer);
+    }
+
+    if (avcodec_open2(outputContext, codec, NULL) < 0)
+    {
+        if (debugLog != NULL) debugLog("Could not open output video codec");
+        return -1;
+    }
+
+    if (debugLog != NULL)
+    {
+        char buffer [100];
+        snprintf(buffer, 100, "Codec: %s is open", codec->long_name);
+        debugLog(buffer);
+    }
+
+    return 0;
+}
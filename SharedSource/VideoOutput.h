@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+#include "SystemCallbacks.h"
+
+extern "C" {
+	#include "libavformat/avformat.h"
+	#include "libavcodec/avcodec.h"
+	#include "libavutil/opt.h"
+}
+
+typedef struct EncodeStream {
+    AVFormatContext *formatContext;
+    AVStream *stream;
+    AVCodec *codec;
+    uint8_t *picture_buffer;
+    AVFrame *outputFrame;
+} EncodeStream;
+
+//Codec parameters shared by the main output and every rendition.
+typedef struct VideoCodecSettings {
+    int width;
+    int height;
+    int framerate;
+    int bitrate;
+    bool globalHeader;
+    AVRational timeBase;
+    int gopSize;
+    bool lowLatency;
+    int slices;
+    //x264 preset, NULL keeps ultrafast.
+    const char *preset;
+    //Constant quality instead of the bitrate, the x264 crf or the mpeg4 qscale. 0 encodes to the bitrate.
+    int crf;
+} VideoCodecSettings;
+
+//Allocates the format context for the file and a video stream for the preferred codec,
+//or for the container default when the container can not hold it.
+EncodeStream* OpenVideoOutput(const char *file, LogCallback debugLog, AVCodecID preferredCodec = AV_CODEC_ID_NONE);
+
+//Flushes nothing, only closes the file and frees the format context and its streams.
+void CloseVideoOutput(EncodeStream *output, LogCallback debugLog);
+
+int ConfigureVideoCodec(AVCodecContext *outputContext, AVCodec *codec, const VideoCodecSettings *settings, LogCallback debugLog);
+
+int OpenVideoCodec(AVCodecContext *outputContext, AVCodec *codec, LogCallback debugLog);